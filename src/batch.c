@@ -0,0 +1,450 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include "batch.h"
+#include "dataset_binary.h"
+#include "clustering.h"
+#include "evaluation.h"
+#include "clu_io.h"
+#include "parallel.h"
+#include "stats.h"
+
+#define DEFAULT_ITERATION_LIMIT 100
+#define DEFAULT_BATCH_SIZE 1024
+#define MAX_MANIFEST_LINE (BATCH_PATH_SIZE + 64)
+
+// Nomes aceitos no lugar do numero do menu, na mesma ordem
+static const char* algorithm_names[] = {
+    "kmeans", "single", "complete", "average", "weighted", "ward", "centroid", "median", "minibatch"
+};
+#define ALGORITHM_COUNT (int)(sizeof(algorithm_names) / sizeof(algorithm_names[0]))
+
+// Uma linha de resultado por vez, para as tarefas simultaneas nao se misturarem
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+BatchOptions batch_default_options(void){
+    BatchOptions options;
+    options.iteration_limit = DEFAULT_ITERATION_LIMIT;
+    options.n_threads = 1;
+    options.n_workers = 0;
+    options.seed = 1;
+    options.n_restarts = 0;
+    options.batch_size = DEFAULT_BATCH_SIZE;
+    options.output_dir = NULL;
+    options.reference_dir = CLU_RESULTS_DIR;
+    return options;
+}
+
+const char* algorithm_name(int algorithm){
+    return algorithm >= 1 && algorithm <= ALGORITHM_COUNT ? algorithm_names[algorithm - 1] : "?";
+}
+
+int parse_algorithm(const char* name){
+    char* end;
+    long number = strtol(name, &end, 10);
+    if(end != name && !*end) return number >= 1 && number <= ALGORITHM_COUNT ? (int)number : 0;
+
+    for(int i = 0; i < ALGORITHM_COUNT; i++)
+        if(!strcmp(name, algorithm_names[i])) return i + 1;
+    return 0;
+}
+
+BatchJob* load_manifest(const char* filename, int* count){
+    *count = 0;
+    FILE* file = fopen(filename, "r");
+    if(!file){
+        perror("Erro ao abrir o manifesto");
+        return NULL;
+    }
+
+    int capacity = 16;
+    BatchJob* jobs = malloc(sizeof(BatchJob) * capacity);
+    char line[MAX_MANIFEST_LINE];
+    int line_number = 0;
+
+    while(jobs && fgets(line, sizeof(line), file)){
+        line_number++;
+        char* c = line;
+        while(isspace((unsigned char)*c)) c++;
+        if(!*c || *c == '#') continue;
+
+        char dataset[BATCH_PATH_SIZE], algorithm[32];
+        int k_min, k_max;
+        int fields = sscanf(c, "%255s %31s %d %d", dataset, algorithm, &k_min, &k_max);
+        if(fields == 3) k_max = k_min;
+
+        int chosen_algorithm = fields >= 3 ? parse_algorithm(algorithm) : 0;
+        if(!chosen_algorithm || k_min < 1 || k_max < k_min){
+            fprintf(stderr, "Aviso: linha %d do manifesto invalida, ignorada.\n", line_number);
+            continue;
+        }
+
+        if(*count == capacity){
+            capacity *= 2;
+            BatchJob* grown = realloc(jobs, sizeof(BatchJob) * capacity);
+            if(!grown){
+                free(jobs);
+                jobs = NULL;
+                break;
+            }
+            jobs = grown;
+        }
+
+        BatchJob* job = &jobs[(*count)++];
+        strcpy(job->dataset, dataset);
+        job->algorithm = chosen_algorithm;
+        job->k_min = k_min;
+        job->k_max = k_max;
+    }
+
+    fclose(file);
+    if(!jobs){
+        fprintf(stderr, "Erro de alocacao ao ler o manifesto.\n");
+        *count = 0;
+    }
+    return jobs;
+}
+
+void print_batch_header(void){
+    printf("dataset\talgoritmo\tk\tari\tnmi\tfowlkes_mallows\tsegundos\n");
+    fflush(stdout);
+}
+
+// Nome do dataset sem pasta e sem extensao, como nos arquivos de resultado
+static void dataset_name(const char* path, char* name, size_t size){
+    if(!strcmp(path, "-")) path = "stdin";
+    const char* start = strrchr(path, '/');
+    start = start ? start + 1 : path;
+    snprintf(name, size, "%s", start);
+    char* extension = strrchr(name, '.');
+    if(extension && extension != name) *extension = 0;
+}
+
+void print_job_stats(const BatchJob* job){
+#ifdef CCLUSTERING_STATS
+    char name[BATCH_PATH_SIZE], run[2 * BATCH_PATH_SIZE];
+    dataset_name(job->dataset, name, sizeof(name));
+    snprintf(run, sizeof(run), "%s %s k=%d-%d", name, algorithm_name(job->algorithm), job->k_min, job->k_max);
+    stats_print(stderr, run);
+#else
+    (void)job;
+#endif
+}
+
+static double elapsed_seconds(const struct timespec* start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Linha de resultado de um k: com gabarito, as metricas de cluster_id contra clusters_ref
+// (count pontos) e o ARI em ari
+static void print_job_line(const int* cluster_id, const int* clusters_ref, int count, const char* name,
+                           const BatchJob* job, int k, double seconds, double* ari){
+    char line[BATCH_PATH_SIZE + 128];
+    int used = snprintf(line, sizeof(line), "%s\t%s\t%d", name, algorithm_name(job->algorithm), k);
+    if(clusters_ref){
+        ClusterAgreement agreement;
+        cluster_agreement(cluster_id, clusters_ref, count, 0, &agreement);
+        *ari = agreement.ari;
+        snprintf(line + used, sizeof(line) - used, "\t%f\t%f\t%f\t%.3f\n",
+                 agreement.ari, agreement.nmi, agreement.fowlkes_mallows, seconds);
+    }
+    else snprintf(line + used, sizeof(line) - used, "\t-\t-\t-\t%.3f\n", seconds);
+
+    pthread_mutex_lock(&output_lock);
+    fputs(line, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&output_lock);
+}
+
+// Grava e reporta o agrupamento atual do dataset
+static int report_job_result(const DataSet* dataset, const int* clusters_ref, const char* name,
+                             const BatchJob* job, const BatchOptions* options, int k, double seconds, double* ari){
+    int ok = 1;
+    if(options->output_dir){
+        char path[2 * BATCH_PATH_SIZE];
+        clu_result_path(path, sizeof(path), options->output_dir, name, job->algorithm, k);
+        ok = write_clusters(dataset, dataset->cluster_id, path);
+    }
+    print_job_line(dataset->cluster_id, clusters_ref, dataset->count, name, job, k, seconds, ari);
+    return ok;
+}
+
+// Rotulos e gabarito dos pontos ja rotulados, para as metricas no fim da passada. So
+// crescem com os pontos quando ha gabarito.
+typedef struct {
+    int* cluster_id;
+    int* clusters_ref;
+    int count;
+    int capacity;
+} StreamedLabels;
+
+static int collect_labels(StreamedLabels* labels, CluReference* reference, const DataSet* batch){
+    if(labels->count + batch->count > labels->capacity){
+        int capacity = labels->capacity ? labels->capacity : batch->count;
+        while(capacity < labels->count + batch->count) capacity *= 2;
+        int* cluster_id = realloc(labels->cluster_id, sizeof(int) * capacity);
+        if(cluster_id) labels->cluster_id = cluster_id;
+        int* clusters_ref = realloc(labels->clusters_ref, sizeof(int) * capacity);
+        if(clusters_ref) labels->clusters_ref = clusters_ref;
+        if(!cluster_id || !clusters_ref){
+            perror("Falha ao alocar os rotulos para as metricas");
+            return 0;
+        }
+        labels->capacity = capacity;
+    }
+    for(int i = 0; i < batch->count; i++){
+        labels->cluster_id[labels->count] = batch->cluster_id[i];
+        labels->clusters_ref[labels->count++] = take_reference_cluster(reference, dataset_label(batch, i));
+    }
+    return 1;
+}
+
+// k-medias em lotes sem carregar o dataset: para cada k, treina lendo o arquivo em lotes
+// e numa segunda passada rotula, grava e casa com o gabarito lote a lote. Na entrada
+// padrao ("-") nao ha segunda passada: e o modo online, em que cada lote e rotulado com os
+// centroides do momento e logo depois ensina o modelo.
+static int run_streamed_mini_batch(const BatchJob* job, const BatchOptions* options, const char* name, double* ari){
+    bool online = !strcmp(job->dataset, "-");
+    if(online && job->k_min != job->k_max){
+        fprintf(stderr, "A entrada padrao so pode ser lida uma vez: use um k so.\n");
+        return 0;
+    }
+
+    // Sem gabarito as metricas ficam de fora; nao e um erro
+    CluReference* reference = NULL;
+    char ref_filename[2 * BATCH_PATH_SIZE];
+    snprintf(ref_filename, sizeof(ref_filename), "%s/%s.clu", options->reference_dir, name);
+    FILE* reference_file = online ? NULL : fopen(ref_filename, "r");
+    if(reference_file){
+        fclose(reference_file);
+        reference = load_clu_reference(ref_filename);
+    }
+
+    int ok = 1;
+    for(int k = job->k_min; k <= job->k_max && ok; k++){
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        MiniBatchOptions mini_batch = mini_batch_default_options(k, options->batch_size, options->iteration_limit);
+        mini_batch.n_threads = options->n_threads;
+        mini_batch.seed = options->seed;
+        KMeansModel* model = online ? NULL : mini_batch_k_means(job->dataset, &mini_batch);
+        DataReader* reader = online || model ? open_data_reader(job->dataset) : NULL;
+        DataSet* batch = reader ? create_dataset(options->batch_size, data_reader_dims(reader)) : NULL;
+        if(!batch){
+            fprintf(stderr, "%s: falha no k-medias em lotes.\n", job->dataset);
+            free_kmeans_model(model);
+            close_data_reader(reader);
+            ok = 0;
+            break;
+        }
+
+        CluFile* clu = NULL;
+        if(options->output_dir){
+            char path[2 * BATCH_PATH_SIZE];
+            clu_result_path(path, sizeof(path), options->output_dir, name, job->algorithm, k);
+            clu = create_clu_file(path);
+            if(!clu) ok = 0;
+        }
+        if(reference) reset_clu_reference(reference);
+        StreamedLabels labels;
+        memset(&labels, 0, sizeof(labels));
+
+        int points = 0;
+        while(ok && read_data_batch(reader, batch)){
+            if(!model) model = kmeans_model_from_batch(batch, k, options->n_threads, options->seed);
+            if(online) kmeans_model_update(model, batch, options->n_threads);
+            else kmeans_model_assign(model, batch, options->n_threads);
+            points += batch->count;
+            if(clu && !append_clusters(clu, batch, batch->cluster_id)) ok = 0;
+            if(reference && !collect_labels(&labels, reference, batch)) ok = 0;
+        }
+        if(clu && !close_clu_file(clu)) ok = 0;
+
+        if(points < k){
+            fprintf(stderr, "%s: k = %d invalido para %d pontos.\n", job->dataset, k, points);
+            ok = 0;
+        }
+        if(ok) print_job_line(labels.cluster_id, reference ? labels.clusters_ref : NULL, labels.count,
+                              name, job, k, elapsed_seconds(&start), ari);
+
+        free(labels.cluster_id);
+        free(labels.clusters_ref);
+        free_dataset(batch);
+        close_data_reader(reader);
+        free_kmeans_model(model);
+    }
+
+    free_clu_reference(reference);
+    return ok;
+}
+
+int run_batch_job(const BatchJob* job, const BatchOptions* options, DataSet** result, double* last_ari){
+    if(result) *result = NULL;
+    double ari = 1.0;
+
+    // Sem janela, o k-medias em lotes nunca tem o dataset inteiro na memoria
+    if(job->algorithm == 9 && !result){
+        char name[BATCH_PATH_SIZE];
+        dataset_name(job->dataset, name, sizeof(name));
+        int ok = run_streamed_mini_batch(job, options, name, &ari);
+        if(last_ari) *last_ari = ari;
+        return ok;
+    }
+    if(!strcmp(job->dataset, "-")){
+        fprintf(stderr, "A entrada padrao (-) so e aceita pelo k-medias em lotes, sem janela.\n");
+        return 0;
+    }
+
+    DataSet* dataset = is_binary_dataset_file(job->dataset) ? load_binary_dataset(job->dataset)
+                                                            : load_data_from_file_threads(job->dataset, options->n_threads);
+    if(!dataset){
+        fprintf(stderr, "Falha ao carregar %s.\n", job->dataset);
+        return 0;
+    }
+    if(job->k_min < 1 || job->k_max < job->k_min || job->k_max > dataset->count){
+        fprintf(stderr, "%s: k de %d a %d invalido para %d pontos.\n",
+                job->dataset, job->k_min, job->k_max, dataset->count);
+        free_dataset(dataset);
+        return 0;
+    }
+
+    char name[BATCH_PATH_SIZE];
+    dataset_name(job->dataset, name, sizeof(name));
+
+    // Sem gabarito as metricas ficam de fora; nao e um erro
+    int* clusters_ref = NULL;
+    char ref_filename[2 * BATCH_PATH_SIZE];
+    snprintf(ref_filename, sizeof(ref_filename), "%s/%s.clu", options->reference_dir, name);
+    FILE* reference = fopen(ref_filename, "r");
+    if(reference){
+        fclose(reference);
+        clusters_ref = load_clusters_for_dataset(ref_filename, dataset);
+    }
+
+    int ok = 1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(job->algorithm == 1){
+        for(int k = job->k_min; k <= job->k_max; k++){
+            KMeansOptions kmeans = kmeans_default_options(k, options->iteration_limit);
+            kmeans.n_threads = options->n_threads;
+            kmeans.seed = options->seed;
+            if(options->n_restarts > 0){
+                kmeans.seeding = KMEANS_SEED_AUTO;
+                kmeans.n_restarts = options->n_restarts;
+            }
+            k_means_with_options(dataset, &kmeans);
+            ok &= report_job_result(dataset, clusters_ref, name, job, options, k, elapsed_seconds(&start), &ari);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+    }
+
+    else if(job->algorithm == 9){
+        // Com janela: o treino le em lotes, mas os pontos ja estao carregados para ela
+        for(int k = job->k_min; k <= job->k_max; k++){
+            MiniBatchOptions mini_batch = mini_batch_default_options(k, options->batch_size, options->iteration_limit);
+            mini_batch.n_threads = options->n_threads;
+            mini_batch.seed = options->seed;
+            KMeansModel* model = mini_batch_k_means(job->dataset, &mini_batch);
+            if(!model){
+                fprintf(stderr, "%s: falha no k-medias em lotes.\n", job->dataset);
+                ok = 0;
+                break;
+            }
+            kmeans_model_assign(model, dataset, options->n_threads);
+            free_kmeans_model(model);
+            ok &= report_job_result(dataset, clusters_ref, name, job, options, k, elapsed_seconds(&start), &ari);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+    }
+
+    else{
+        // Um dendrograma so; o tempo do primeiro k inclui a construcao dele
+        Dendrogram* dendrogram = hac_dendrogram(dataset, (Linkage)(job->algorithm - 2));
+        if(!dendrogram){
+            fprintf(stderr, "%s: falha ao construir o dendrograma.\n", job->dataset);
+            ok = 0;
+        } else {
+            for(int k = job->k_min; k <= job->k_max; k++){
+                cut_dendrogram(dendrogram, k, dataset);
+                ok &= report_job_result(dataset, clusters_ref, name, job, options, k, elapsed_seconds(&start), &ari);
+                clock_gettime(CLOCK_MONOTONIC, &start);
+            }
+            free_dendrogram(dendrogram);
+        }
+    }
+
+    free_clusters(clusters_ref);
+    if(last_ari) *last_ari = ari;
+    if(result && ok) *result = dataset;
+    else free_dataset(dataset);
+    return ok;
+}
+
+typedef struct {
+    const BatchJob* jobs;
+    int count;
+    const BatchOptions* options;
+    pthread_mutex_t lock;
+    int next; // proxima tarefa ainda nao pega
+    int failures;
+    bool stats_per_job; // um worker so: a instrumentacao e so desta tarefa
+} BatchPool;
+
+static void* batch_worker(void* argument){
+    BatchPool* pool = (BatchPool*)argument;
+    while(1){
+        pthread_mutex_lock(&pool->lock);
+        int job = pool->next < pool->count ? pool->next++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if(job < 0) break;
+
+        if(pool->stats_per_job) STATS_RESET();
+        if(!run_batch_job(&pool->jobs[job], pool->options, NULL, NULL)){
+            pthread_mutex_lock(&pool->lock);
+            pool->failures++;
+            pthread_mutex_unlock(&pool->lock);
+        }
+        if(pool->stats_per_job) print_job_stats(&pool->jobs[job]);
+    }
+    return NULL;
+}
+
+int run_batch(const BatchJob* jobs, int count, const BatchOptions* options){
+    int n_workers = options->n_workers > 0 ? options->n_workers : available_threads();
+    if(n_workers > count) n_workers = count;
+
+    BatchPool pool;
+    pool.jobs = jobs;
+    pool.count = count;
+    pool.options = options;
+    pool.next = 0;
+    pool.failures = 0;
+    pool.stats_per_job = n_workers <= 1;
+    pthread_mutex_init(&pool.lock, NULL);
+    STATS_RESET();
+
+    // A thread que chamou tambem trabalha; se alguma nao subir, as outras pegam a parte dela
+    pthread_t* threads = malloc(sizeof(pthread_t) * (n_workers > 1 ? n_workers : 1));
+    int started = 0;
+    for(int t = 1; t < n_workers && threads; t++){
+        if(pthread_create(&threads[started], NULL, batch_worker, &pool) != 0) break;
+        started++;
+    }
+
+    batch_worker(&pool);
+    for(int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+    if(!pool.stats_per_job) STATS_PRINT(stderr, "manifesto");
+    return pool.failures;
+}
@@ -0,0 +1,62 @@
+/* date = October 17th 2026 7:30 pm */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "data_loader.h"
+
+#define BATCH_PATH_SIZE (1 << 8)
+
+// Uma tarefa sem interacao: um dataset, um algoritmo e um intervalo de k.
+// Os algoritmos seguem a numeracao do menu (1 = k-medias ... 9 = k-medias em lotes).
+typedef struct {
+    char dataset[BATCH_PATH_SIZE]; // .txt ou .ccb
+    int algorithm;
+    int k_min;
+    int k_max;
+} BatchJob;
+
+// Parametros comuns a todas as tarefas
+typedef struct {
+    int iteration_limit; // k-medias: iteracoes; em lotes: quantidade de lotes
+    int n_threads; // threads de cada tarefa (0 = todos os nucleos)
+    int n_workers; // tarefas rodando ao mesmo tempo (0 = todos os nucleos)
+    unsigned long long seed;
+    int n_restarts; // > 0: k-means++ com essa quantidade de inicializacoes
+    int batch_size; // pontos por lote do k-medias em lotes
+    const char* output_dir; // onde gravar os .clu; NULL nao grava
+    const char* reference_dir; // onde procurar o gabarito <dataset>.clu
+} BatchOptions;
+
+BatchOptions batch_default_options(void);
+
+// Numero do algoritmo a partir do numero ou do nome ("kmeans", "single", "ward", ...).
+// Devolve 0 se nao reconhecer.
+int parse_algorithm(const char* name);
+
+// Nome curto do algoritmo (o mesmo aceito por parse_algorithm)
+const char* algorithm_name(int algorithm);
+
+// Manifesto: uma tarefa por linha, "<dataset> <algoritmo> <k> [k_max]". Linhas em branco
+// e comentarios (#) sao ignorados; linhas invalidas sao avisadas no stderr e puladas.
+BatchJob* load_manifest(const char* filename, int* count);
+
+// Roda uma tarefa e escreve uma linha por k na saida padrao (ver print_batch_header).
+// Se result nao for NULL, devolve nele o dataset com o ultimo agrupamento (o chamador
+// libera) e em last_ari o ARI dele (1 sem gabarito). Devolve 0 se a tarefa falhar.
+int run_batch_job(const BatchJob* job, const BatchOptions* options, DataSet** result, double* last_ari);
+
+// Roda as tarefas num conjunto de n_workers threads; cada thread pega a proxima tarefa
+// livre assim que termina a anterior. Devolve quantas falharam. A instrumentacao sai por
+// tarefa com um worker so; com varios, os totais se misturam e sai um resumo do lote.
+int run_batch(const BatchJob* jobs, int count, const BatchOptions* options);
+
+// Resumo da instrumentacao (ver stats.h) no stderr, com o nome da tarefa. Sem
+// CCLUSTERING_STATS nao faz nada.
+void print_job_stats(const BatchJob* job);
+
+// Cabecalho das colunas separadas por tabulacao: dataset, algoritmo, k, ARI, NMI,
+// Fowlkes-Mallows e segundos (as tres metricas ficam "-" sem gabarito)
+void print_batch_header(void);
+
+#endif // BATCH_H
@@ -0,0 +1,429 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "data_loader.h"
+#include "dataset_binary.h"
+#include "clustering.h"
+#include "evaluation.h"
+#include "clu_io.h"
+#include "batch.h"
+#include "distance.h"
+
+// Benchmark com dados sinteticos: gera cada dataset, grava em .txt e .ccb e mede cada fase
+// (carga, matriz e juncoes do HAC, k-medias, ARI, gravacao do .clu) de cada algoritmo, para
+// cada tamanho e quantidade de threads. Uma linha por fase em CSV (ou um objeto em JSON),
+// com o kernel de distancia escolhido para a CPU (ver distance.h).
+// Cada dataset roda num processo filho, para o pico de memoria de um nao vazar nos outros.
+
+#define MAX_LIST 16
+#define ALGORITHM_COUNT 9
+#define BENCH_PATH_SIZE (1 << 9)
+#define BLOB_SPREAD 2.0 // desvio padrao de cada nuvem gaussiana
+#define BOX_SIZE 100.0 // os pontos ficam em [0, BOX_SIZE) em cada coordenada
+#define ADVERSARIAL_COPIES 4 // copias de cada ponto do dataset adversarial
+#define TWO_PI 6.28318530717958647692
+
+typedef enum {
+    GENERATOR_BLOBS = 0, // k nuvens gaussianas; o gabarito e a nuvem de origem
+    GENERATOR_UNIFORM, // uniforme no cubo; o gabarito e a faixa da primeira coordenada
+    GENERATOR_ADVERSARIAL, // pontos repetidos numa reta: so empates e cadeias
+    GENERATOR_COUNT
+} Generator;
+
+static const char* generator_names[GENERATOR_COUNT] = { "blobs", "uniform", "adversarial" };
+
+typedef struct {
+    int sizes[MAX_LIST];
+    int n_sizes;
+    int thread_counts[MAX_LIST];
+    int n_thread_counts;
+    bool generators[GENERATOR_COUNT];
+    bool algorithms[ALGORITHM_COUNT + 1]; // numeracao do menu, 1 a 9
+    int k;
+    int dims;
+    int iteration_limit;
+    int batch_size;
+    int max_hac; // maior n para os algoritmos hierarquicos (O(n^2))
+    unsigned long long seed;
+    const char* work_dir;
+    bool json;
+} BenchConfig;
+
+// Identifica as linhas de uma mesma execucao
+typedef struct {
+    const char* generator;
+    int count;
+    const char* algorithm;
+    int threads;
+} BenchRun;
+
+static const BenchConfig* config;
+static int records = 0;
+
+static uint64_t random_state;
+
+static uint64_t next_random(void){
+    uint64_t z = (random_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double random_unit(void){
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double random_normal(void){
+    double u = random_unit();
+    while(u <= 0) u = random_unit();
+    return sqrt(-2.0 * log(u)) * cos(TWO_PI * random_unit());
+}
+
+static double now_seconds(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Pico de memoria residente ate agora do processo deste dataset (ver run_dataset_in_child),
+// em KiB: cada fase inclui o dataset carregado e o que as fases anteriores dele usaram
+static long peak_rss_kb(void){
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+static void report(const BenchRun* run, const char* phase, double seconds){
+    double throughput = seconds > 0 ? run->count / seconds : 0;
+    if(config->json){
+        printf("%s  {\"generator\": \"%s\", \"n\": %d, \"dims\": %d, \"k\": %d, \"algorithm\": \"%s\", "
+               "\"threads\": %d, \"phase\": \"%s\", \"seconds\": %.6f, \"points_per_second\": %.1f, "
+               "\"peak_rss_kb\": %ld, \"kernel\": \"%s\"}",
+               records ? ",\n" : "", run->generator, run->count, config->dims, config->k, run->algorithm,
+               run->threads, phase, seconds, throughput, peak_rss_kb(), distance_kernel_name());
+    }
+    else printf("%s,%d,%d,%d,%s,%d,%s,%.6f,%.1f,%ld,%s\n", run->generator, run->count, config->dims, config->k,
+                run->algorithm, run->threads, phase, seconds, throughput, peak_rss_kb(), distance_kernel_name());
+    records++;
+    fflush(stdout);
+}
+
+// Gera o dataset direto em .txt e devolve o gabarito (cluster de origem de cada ponto)
+static int* generate_dataset(Generator generator, int count, const char* path){
+    FILE* file = fopen(path, "w");
+    int* reference = malloc(sizeof(int) * count);
+    double* point = malloc(sizeof(double) * config->dims);
+    double* centers = malloc(sizeof(double) * config->dims * config->k);
+    if(!file || !reference || !point || !centers){
+        fprintf(stderr, "Falha ao gerar %s\n", path);
+        if(file) fclose(file);
+        free(reference);
+        free(point);
+        free(centers);
+        return NULL;
+    }
+
+    int k = config->k, dims = config->dims;
+    for(int c = 0; c < k * dims; c++) centers[c] = random_unit() * BOX_SIZE;
+    int positions = (count + ADVERSARIAL_COPIES - 1) / ADVERSARIAL_COPIES;
+
+    fprintf(file, "sample_label");
+    for(int d = 0; d < dims; d++) fprintf(file, "\td%d", d + 1);
+    fputc('\n', file);
+
+    for(int i = 0; i < count; i++){
+        if(generator == GENERATOR_BLOBS){
+            int c = (int)(next_random() % (uint64_t)k);
+            for(int d = 0; d < dims; d++) point[d] = centers[c * dims + d] + BLOB_SPREAD * random_normal();
+            reference[i] = c;
+        }
+        else if(generator == GENERATOR_UNIFORM){
+            for(int d = 0; d < dims; d++) point[d] = random_unit() * BOX_SIZE;
+            reference[i] = (int)(point[0] / BOX_SIZE * k);
+        }
+        else{
+            // Todas as coordenadas iguais e cada posicao repetida: distancias empatadas
+            int position = i / ADVERSARIAL_COPIES;
+            for(int d = 0; d < dims; d++) point[d] = position;
+            reference[i] = (int)((long long)position * k / positions);
+        }
+
+        fprintf(file, "p%d", i);
+        for(int d = 0; d < dims; d++) fprintf(file, "\t%.6f", point[d]);
+        fputc('\n', file);
+    }
+
+    free(point);
+    free(centers);
+    if(fclose(file) != 0){
+        fprintf(stderr, "Falha ao gravar %s\n", path);
+        free(reference);
+        return NULL;
+    }
+    return reference;
+}
+
+// ARI contra o gabarito e gravacao do .clu do agrupamento atual
+static void score_and_write(const BenchRun* run, const DataSet* dataset, const int* reference, const char* clu_path){
+    ClusterAgreement agreement;
+    double start = now_seconds();
+    cluster_agreement(dataset->cluster_id, reference, dataset->count, 0, &agreement);
+    report(run, "ari", now_seconds() - start);
+
+    start = now_seconds();
+    write_clusters(dataset, dataset->cluster_id, clu_path);
+    report(run, "write_clu", now_seconds() - start);
+}
+
+static void run_algorithm(int algorithm, int threads, DataSet* dataset, const int* reference,
+                          const char* generator, const char* txt_path, const char* clu_path){
+    BenchRun run = { generator, dataset->count, algorithm_name(algorithm), threads };
+
+    if(algorithm == 1){
+        KMeansOptions options = kmeans_default_options(config->k, config->iteration_limit);
+        options.n_threads = threads;
+        double start = now_seconds();
+        k_means_with_options(dataset, &options);
+        report(&run, "kmeans", now_seconds() - start);
+    }
+    else if(algorithm == 9){
+        MiniBatchOptions options = mini_batch_default_options(config->k, config->batch_size, config->iteration_limit);
+        options.n_threads = threads;
+        options.seed = config->seed;
+        double start = now_seconds();
+        KMeansModel* model = mini_batch_k_means(txt_path, &options);
+        report(&run, "minibatch", now_seconds() - start);
+        if(!model) return;
+
+        start = now_seconds();
+        kmeans_model_assign(model, dataset, threads);
+        report(&run, "minibatch_assign", now_seconds() - start);
+        free_kmeans_model(model);
+    }
+    else{
+        HacTimings timings;
+        Dendrogram* dendrogram = hac_dendrogram_timed(dataset, (Linkage)(algorithm - 2), &timings);
+        if(!dendrogram) return;
+        if(algorithm != 2) report(&run, "hac_matrix", timings.matrix_seconds);
+        report(&run, "hac_merge", timings.merge_seconds);
+
+        double start = now_seconds();
+        cut_dendrogram(dendrogram, config->k, dataset);
+        report(&run, "cut", now_seconds() - start);
+        free_dendrogram(dendrogram);
+    }
+
+    score_and_write(&run, dataset, reference, clu_path);
+}
+
+static void run_dataset(Generator generator, int count){
+    const char* name = generator_names[generator];
+    char txt_path[BENCH_PATH_SIZE], ccb_path[BENCH_PATH_SIZE], clu_path[BENCH_PATH_SIZE];
+    snprintf(txt_path, sizeof(txt_path), "%s/bench_%s_%d.txt", config->work_dir, name, count);
+    snprintf(ccb_path, sizeof(ccb_path), "%s/bench_%s_%d" BINARY_DATASET_EXTENSION, config->work_dir, name, count);
+    snprintf(clu_path, sizeof(clu_path), "%s/bench_%s_%d.clu", config->work_dir, name, count);
+
+    fprintf(stderr, "%s, n = %d...\n", name, count);
+    int* reference = generate_dataset(generator, count, txt_path);
+    if(!reference) return;
+
+    // Carga do texto para cada quantidade de threads; o ultimo dataset segue adiante
+    DataSet* dataset = NULL;
+    for(int t = 0; t < config->n_thread_counts; t++){
+        BenchRun run = { name, count, "-", config->thread_counts[t] };
+        free_dataset(dataset);
+        double start = now_seconds();
+        dataset = load_data_from_file_threads(txt_path, config->thread_counts[t]);
+        report(&run, "load_txt", now_seconds() - start);
+    }
+
+    if(dataset && write_binary_dataset(dataset, ccb_path)){
+        BenchRun run = { name, count, "-", 1 };
+        double start = now_seconds();
+        DataSet* binary = load_binary_dataset(ccb_path);
+        report(&run, "load_ccb", now_seconds() - start);
+        free_dataset(binary);
+    }
+
+    for(int algorithm = 1; dataset && algorithm <= ALGORITHM_COUNT; algorithm++){
+        if(!config->algorithms[algorithm]) continue;
+
+        // O HAC e sequencial e quadratico: uma execucao so, ate max_hac pontos
+        bool hierarchical = algorithm > 1 && algorithm < 9;
+        if(hierarchical && count > config->max_hac) continue;
+        int runs = hierarchical ? 1 : config->n_thread_counts;
+
+        for(int t = 0; t < runs; t++)
+            run_algorithm(algorithm, hierarchical ? 1 : config->thread_counts[t], dataset, reference,
+                          name, txt_path, clu_path);
+    }
+
+    free_dataset(dataset);
+    free(reference);
+    remove(txt_path);
+    remove(ccb_path);
+    remove(clu_path);
+}
+
+// Roda o dataset num processo filho e espera. O ru_maxrss so cresce durante a vida do
+// processo: no mesmo processo, todo dataset depois do maior repetiria o pico dele. O filho
+// sai com 1 se houver linhas na saida, para a virgula do JSON seguir certa no pai.
+static void run_dataset_in_child(Generator generator, int count){
+    fflush(stdout);
+    pid_t child = fork();
+    if(child < 0){
+        perror("Falha ao criar o processo do benchmark");
+        return;
+    }
+    if(child == 0){
+        run_dataset(generator, count);
+        fflush(stdout);
+        _exit(records > 0);
+    }
+
+    int status;
+    while(waitpid(child, &status, 0) < 0);
+    if(!WIFEXITED(status))
+        fprintf(stderr, "%s, n = %d: processo interrompido pelo sinal %d.\n", generator_names[generator], count, WTERMSIG(status));
+    else if(WEXITSTATUS(status) && !records) records = 1;
+}
+
+// Lista de inteiros separados por virgula; devolve quantos leu (0 se algum for invalido)
+static int parse_int_list(const char* text, int* values){
+    int n = 0;
+    const char* c = text;
+    while(*c && n < MAX_LIST){
+        char* end;
+        long value = strtol(c, &end, 10);
+        if(end == c || value < 0 || value > 1000000000) return 0;
+        values[n++] = (int)value;
+        if(*end == ',') end++;
+        else if(*end) return 0;
+        c = end;
+    }
+    return n;
+}
+
+// Nomes separados por virgula; "all" marca todos
+static int parse_name_list(const char* text, bool* selected, int first, int last, int (*lookup)(const char*)){
+    char buffer[BENCH_PATH_SIZE];
+    snprintf(buffer, sizeof(buffer), "%s", text);
+    for(int i = first; i <= last; i++) selected[i] = false;
+
+    for(char* name = strtok(buffer, ","); name; name = strtok(NULL, ",")){
+        if(!strcmp(name, "all")){
+            for(int i = first; i <= last; i++) selected[i] = true;
+            continue;
+        }
+        int index = lookup(name);
+        if(index < first || index > last){
+            fprintf(stderr, "Nome desconhecido: %s\n", name);
+            return 0;
+        }
+        selected[index] = true;
+    }
+    return 1;
+}
+
+static int find_generator(const char* name){
+    for(int g = 0; g < GENERATOR_COUNT; g++)
+        if(!strcmp(name, generator_names[g])) return g;
+    return -1;
+}
+
+static void print_usage(const char* program){
+    fprintf(stderr,
+            "Uso: %s [opcoes]\n"
+            "  --sizes <n,...>        tamanhos (padrao 1000,10000,100000,1000000,10000000)\n"
+            "  --threads <t,...>      quantidades de threads (padrao 1)\n"
+            "  --generators <g,...>   blobs, uniform, adversarial ou all (padrao all)\n"
+            "  --algorithms <a,...>   kmeans, single, ..., minibatch ou all (padrao all)\n"
+            "  --k <k>                clusters gerados e pedidos (padrao 8)\n"
+            "  --dims <d>             coordenadas de cada ponto (padrao 2)\n"
+            "  --iterations <n>       iteracoes do k-medias / lotes do k-medias em lotes (padrao 50)\n"
+            "  --batch-size <n>       pontos por lote (padrao 1024)\n"
+            "  --max-hac <n>          maior n dos algoritmos hierarquicos (padrao 10000)\n"
+            "  --seed <n>             semente dos geradores (padrao 1)\n"
+            "  --dir <pasta>          pasta dos arquivos temporarios (padrao /tmp)\n"
+            "  --json                 saida em JSON em vez de CSV\n",
+            program);
+}
+
+int main(int argc, char *argv[]){
+    BenchConfig settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.n_sizes = parse_int_list("1000,10000,100000,1000000,10000000", settings.sizes);
+    settings.n_thread_counts = parse_int_list("1", settings.thread_counts);
+    for(int g = 0; g < GENERATOR_COUNT; g++) settings.generators[g] = true;
+    for(int a = 1; a <= ALGORITHM_COUNT; a++) settings.algorithms[a] = true;
+    settings.k = 8;
+    settings.dims = 2;
+    settings.iteration_limit = 50;
+    settings.batch_size = 1024;
+    settings.max_hac = 10000;
+    settings.seed = 1;
+    settings.work_dir = "/tmp";
+
+    for(int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        if(!strcmp(arg, "--json")){
+            settings.json = true;
+            continue;
+        }
+        if(!strcmp(arg, "-h") || !strcmp(arg, "--help")){
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if(i + 1 >= argc){
+            fprintf(stderr, "Falta o valor de %s\n", arg);
+            return EXIT_FAILURE;
+        }
+        const char* value = argv[++i];
+
+        int ok = 1;
+        if(!strcmp(arg, "--sizes")) ok = (settings.n_sizes = parse_int_list(value, settings.sizes)) > 0;
+        else if(!strcmp(arg, "--threads")) ok = (settings.n_thread_counts = parse_int_list(value, settings.thread_counts)) > 0;
+        else if(!strcmp(arg, "--generators")) ok = parse_name_list(value, settings.generators, 0, GENERATOR_COUNT - 1, find_generator);
+        else if(!strcmp(arg, "--algorithms")) ok = parse_name_list(value, settings.algorithms, 1, ALGORITHM_COUNT, parse_algorithm);
+        else if(!strcmp(arg, "--k")) ok = (settings.k = atoi(value)) > 0;
+        else if(!strcmp(arg, "--dims")) ok = (settings.dims = atoi(value)) > 0;
+        else if(!strcmp(arg, "--iterations")) ok = (settings.iteration_limit = atoi(value)) > 0;
+        else if(!strcmp(arg, "--batch-size")) ok = (settings.batch_size = atoi(value)) > 0;
+        else if(!strcmp(arg, "--max-hac")) ok = (settings.max_hac = atoi(value)) >= 0;
+        else if(!strcmp(arg, "--seed")) settings.seed = strtoull(value, NULL, 10);
+        else if(!strcmp(arg, "--dir")) settings.work_dir = value;
+        else {
+            fprintf(stderr, "Opcao desconhecida: %s\n", arg);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if(!ok){
+            fprintf(stderr, "Valor invalido para %s: %s\n", arg, value);
+            return EXIT_FAILURE;
+        }
+    }
+
+    config = &settings;
+    random_state = settings.seed;
+
+    if(settings.json) printf("[\n");
+    else printf("generator,n,dims,k,algorithm,threads,phase,seconds,points_per_second,peak_rss_kb,kernel\n");
+
+    for(int s = 0; s < settings.n_sizes; s++){
+        if(settings.sizes[s] < settings.k){
+            fprintf(stderr, "n = %d menor que k = %d, ignorado.\n", settings.sizes[s], settings.k);
+            continue;
+        }
+        for(int g = 0; g < GENERATOR_COUNT; g++)
+            if(settings.generators[g]) run_dataset_in_child((Generator)g, settings.sizes[s]);
+    }
+
+    if(settings.json) printf("\n]\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "clu_io.h"
+#include "stats.h"
+
+// Buffer de saida: as linhas vao inteiras para o disco em blocos deste tamanho
+#define CLU_BUFFER_SIZE (1 << 20)
+// Maior linha possivel: rotulo, '\t', inteiro de 32 bits com sinal e '\n'
+#define MAX_CLU_LINE (MAX_LABEL_LEN + 14)
+#define MAX_REPORTED_LINES 10
+
+void clu_result_path(char* path, size_t size, const char* output_dir, const char* dataset_name,
+                     int chosen_algorithm, int k){
+    snprintf(path, size, "%s/G1_%s_%d_%d.clu", output_dir, dataset_name, chosen_algorithm, k);
+}
+
+// Escreve value em decimal a partir de out e devolve quantos caracteres usou
+static int format_int(char* out, int value){
+    char digits[12];
+    int n = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do{
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude);
+
+    int len = 0;
+    if(value < 0) out[len++] = '-';
+    while(n) out[len++] = digits[--n];
+    return len;
+}
+
+struct CluFile {
+    FILE* file;
+    char* path;
+    char* buffer;
+    size_t used;
+    bool empty; // nenhuma linha ainda: a proxima nao leva '\n' antes
+    bool ok;
+};
+
+CluFile* create_clu_file(const char* path){
+    CluFile* clu = calloc(1, sizeof(CluFile));
+    if(clu){
+        clu->file = fopen(path, "w");
+        clu->path = strdup(path);
+        clu->buffer = malloc(CLU_BUFFER_SIZE);
+    }
+    if(!clu || !clu->file || !clu->path || !clu->buffer){
+        fprintf(stderr, "Erro ao criar o arquivo de clusters %s\n", path);
+        if(clu && clu->file) fclose(clu->file);
+        if(clu){
+            free(clu->path);
+            free(clu->buffer);
+        }
+        free(clu);
+        return NULL;
+    }
+    // O buffer ja e nosso: o stdio so repassa os blocos
+    setvbuf(clu->file, NULL, _IONBF, 0);
+    clu->empty = true;
+    clu->ok = true;
+    return clu;
+}
+
+int append_clusters(CluFile* clu, const DataSet* dataset, const int* cluster_id){
+    for(int i = 0; i < dataset->count && clu->ok; i++){
+        if(clu->used > CLU_BUFFER_SIZE - MAX_CLU_LINE){
+            clu->ok = fwrite(clu->buffer, 1, clu->used, clu->file) == clu->used;
+            clu->used = 0;
+        }
+        if(!clu->empty) clu->buffer[clu->used++] = '\n';
+        clu->empty = false;
+
+        const char* label = dataset_label(dataset, i);
+        size_t label_len = strnlen(label, MAX_LABEL_LEN - 1);
+        memcpy(clu->buffer + clu->used, label, label_len);
+        clu->used += label_len;
+        clu->buffer[clu->used++] = '\t';
+        clu->used += format_int(clu->buffer + clu->used, cluster_id[i]);
+    }
+    return clu->ok;
+}
+
+int close_clu_file(CluFile* clu){
+    if(!clu) return 0;
+    int ok = clu->ok;
+    if(ok && clu->used) ok = fwrite(clu->buffer, 1, clu->used, clu->file) == clu->used;
+    if(fclose(clu->file) != 0) ok = 0;
+    if(!ok) fprintf(stderr, "Erro ao gravar o arquivo de clusters %s\n", clu->path);
+    free(clu->path);
+    free(clu->buffer);
+    free(clu);
+    return ok;
+}
+
+int write_clusters(const DataSet* dataset, const int* cluster_id, const char* path){
+    STATS_TIMER_BEGIN(start);
+    CluFile* clu = create_clu_file(path);
+    int ok = clu && append_clusters(clu, dataset, cluster_id);
+    ok = close_clu_file(clu) && ok;
+    STATS_TIMER_END(TIMER_WRITE_CLU, start);
+    return ok;
+}
+
+void write_clu(DataSet* dataset, char* filename, int k, int chosen_algorithm){
+    char file_path[1 << 8];
+    clu_result_path(file_path, sizeof(file_path), CLU_RESULTS_DIR, filename, chosen_algorithm, k);
+    write_clusters(dataset, dataset->cluster_id, file_path);
+}
+
+// Le um inteiro de [c, end); devolve o fim dele, ou NULL se nao houver um
+static const char* parse_int(const char* c, const char* end, int* value){
+    bool negative = false;
+    if(c < end && (*c == '-' || *c == '+')){
+        negative = *c == '-';
+        c++;
+    }
+    if(c == end || *c < '0' || *c > '9') return NULL;
+
+    long long magnitude = 0;
+    for(; c < end && *c >= '0' && *c <= '9'; c++)
+        if(magnitude <= INT32_MAX) magnitude = magnitude * 10 + (*c - '0');
+    if(magnitude > (negative ? -(long long)INT32_MIN : INT32_MAX)) return NULL;
+    *value = (int)(negative ? -magnitude : magnitude);
+    return c;
+}
+
+// Linha [c, line_end) do .clu: rotulo e cluster. Devolve 0 se estiver em branco, -1 se
+// nao terminar num inteiro (cabecalho ou linha mal formatada) e 1 se estiver ok.
+static int parse_clu_line(const char* c, const char* line_end, const char** label, size_t* label_len, int* cluster){
+    while(c < line_end && (*c == ' ' || *c == '\t')) c++;
+    if(c == line_end) return 0;
+    const char* label_end = c;
+    while(label_end < line_end && *label_end != '\t' && *label_end != ' ') label_end++;
+    const char* p = label_end;
+    while(p < line_end && (*p == ' ' || *p == '\t')) p++;
+
+    const char* number_end = parse_int(p, line_end, cluster);
+    while(number_end && number_end < line_end && (*number_end == ' ' || *number_end == '\t')) number_end++;
+    if(!number_end || number_end != line_end) return -1;
+
+    *label = c;
+    *label_len = label_end - c;
+    if(*label_len > MAX_LABEL_LEN - 1) *label_len = MAX_LABEL_LEN - 1;
+    return 1;
+}
+
+// Indice dos pontos do dataset pelo rotulo. Rotulos repetidos formam uma fila (next):
+// cada linha do arquivo com esse rotulo leva o proximo ponto ainda livre.
+typedef struct {
+    int key; // um ponto com o rotulo da posicao (para comparar), -1 = posicao vazia
+    int head; // ponto livre na frente da fila do rotulo, -1 = todos ja casados
+    uint32_t tag; // parte do hash: quase nunca precisa comparar o texto
+} LabelSlot;
+
+typedef struct {
+    const DataSet* dataset;
+    LabelSlot* slots;
+    size_t mask;
+    int* next;
+} LabelIndex;
+
+static uint64_t hash_label(const char* label, size_t len){
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a
+    for(size_t i = 0; i < len; i++){
+        hash ^= (unsigned char)label[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Posicao do rotulo [label, label + len) no indice (ocupada por ele ou vazia)
+static size_t label_slot(const LabelIndex* index, const char* label, size_t len, uint32_t* tag){
+    uint64_t hash = hash_label(label, len);
+    size_t slot = hash & index->mask;
+    *tag = (uint32_t)(hash >> 32);
+    while(index->slots[slot].key >= 0){
+        if(index->slots[slot].tag == *tag){
+            const char* other = dataset_label(index->dataset, index->slots[slot].key);
+            if(!strncmp(other, label, len) && other[len] == 0) break;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return slot;
+}
+
+// Indexa os pontos [first, count) do dataset; os anteriores ja foram casados em ordem
+static int build_label_index(LabelIndex* index, const DataSet* dataset, int first){
+    size_t capacity = 16;
+    while(capacity < (size_t)(dataset->count - first) * 2) capacity <<= 1;
+    index->dataset = dataset;
+    index->mask = capacity - 1;
+    index->slots = malloc(sizeof(LabelSlot) * capacity);
+    index->next = malloc(sizeof(int) * (dataset->count > 0 ? dataset->count : 1));
+    if(!index->slots || !index->next){
+        free(index->slots);
+        free(index->next);
+        return 0;
+    }
+    for(size_t slot = 0; slot < capacity; slot++) index->slots[slot].key = -1;
+
+    // De tras pra frente: cada ponto entra na frente da fila, que fica na ordem do dataset
+    for(int i = dataset->count - 1; i >= first; i--){
+        const char* label = dataset_label(dataset, i);
+        uint32_t tag;
+        size_t slot = label_slot(index, label, strlen(label), &tag);
+        LabelSlot* entry = &index->slots[slot];
+        index->next[i] = entry->key >= 0 ? entry->head : -1;
+        entry->key = entry->head = i;
+        entry->tag = tag;
+    }
+    return 1;
+}
+
+// Proximo ponto livre com esse rotulo, ou -1
+static int take_label(LabelIndex* index, const char* label, size_t len){
+    if(len > MAX_LABEL_LEN - 1) len = MAX_LABEL_LEN - 1;
+    uint32_t tag;
+    size_t slot = label_slot(index, label, len, &tag);
+    LabelSlot* entry = &index->slots[slot];
+    if(entry->key < 0) return -1;
+    int point = entry->head;
+    if(point >= 0) entry->head = index->next[point];
+    return point;
+}
+
+// Leitura comum: com dataset, casa pelo rotulo; sem, usa a ordem das linhas
+static int* load_clu(const char* filename, int num_points, const DataSet* dataset){
+    size_t size = 0;
+    bool mapped;
+    char* data = map_data_file(filename, &size, &mapped);
+    if(!data){
+        printf("Aviso: Não foi possível abrir o arquivo de clusters de referência '%s'.\n", filename);
+        return NULL;
+    }
+
+    int* clusters = (int*)malloc(sizeof(int) * (num_points > 0 ? num_points : 1));
+    if(!clusters){
+        perror("Falha ao alocar memória para os clusters de referência");
+        unmap_data_file(data, size, mapped);
+        return NULL;
+    }
+    for(int i = 0; i < num_points; i++) clusters[i] = dataset ? -1 : 0;
+
+    LabelIndex index;
+    bool indexed = false;
+    int lines = 0, matched = 0, malformed = 0, unknown = 0;
+    const char* c = data;
+    const char* end = data + size;
+    while(c < end && (dataset || matched < num_points)){
+        const char* line_end = memchr(c, '\n', end - c);
+        if(!line_end) line_end = end;
+        const char* next = line_end < end ? line_end + 1 : end;
+        if(line_end > c && line_end[-1] == '\r') line_end--;
+        lines++;
+
+        const char* label;
+        size_t label_len;
+        int cluster;
+        int parsed = parse_clu_line(c, line_end, &label, &label_len, &cluster);
+        if(!parsed){
+            c = next;
+            continue;
+        }
+        if(parsed < 0){
+            // Primeira linha sem numero: cabecalho
+            if(lines > 1){
+                if(malformed < MAX_REPORTED_LINES)
+                    fprintf(stderr, "Aviso: Linha %d mal formatada no arquivo de referência %s\n", lines, filename);
+                malformed++;
+                if(!dataset) clusters[matched++] = 0;
+            }
+            c = next;
+            continue;
+        }
+
+        if(!dataset){
+            clusters[matched++] = cluster;
+            c = next;
+            continue;
+        }
+
+        // Caso comum: o arquivo segue a ordem do dataset e nem precisa do indice
+        int point = -1;
+        if(!indexed && matched < dataset->count){
+            const char* expected = dataset_label(dataset, matched);
+            if(!strncmp(expected, label, label_len) && expected[label_len] == 0) point = matched;
+        }
+        if(point < 0){
+            if(!indexed && !build_label_index(&index, dataset, matched)){
+                perror("Falha ao alocar memória para os clusters de referência");
+                break;
+            }
+            indexed = true;
+            point = take_label(&index, label, label_len);
+        }
+
+        if(point >= 0){
+            clusters[point] = cluster;
+            matched++;
+        } else unknown++;
+        c = next;
+    }
+
+    if(malformed > MAX_REPORTED_LINES)
+        fprintf(stderr, "Aviso: %d linhas mal formatadas em %s no total.\n", malformed, filename);
+    if(unknown)
+        fprintf(stderr, "Aviso: %d rótulos de '%s' não existem no dataset.\n", unknown, filename);
+    if(matched < num_points)
+        fprintf(stderr, "Aviso: O arquivo de referência '%s' contém menos pontos (%d) do que o dataset (%d).\n", filename, matched, num_points);
+
+    if(indexed){
+        free(index.slots);
+        free(index.next);
+    }
+    unmap_data_file(data, size, mapped);
+    return clusters;
+}
+
+int* load_clusters(const char* filename, int num_points){
+    return load_clu(filename, num_points, NULL);
+}
+
+int* load_clusters_for_dataset(const char* filename, const DataSet* dataset){
+    return load_clu(filename, dataset->count, dataset);
+}
+
+// Gabarito indexado pelo rotulo: as linhas validas do arquivo mapeado, com as de mesmo
+// rotulo encadeadas em ordem (next) a partir de first
+typedef struct {
+    int first; // primeira linha com o rotulo, -1 = posicao vazia
+    int head; // proxima linha ainda nao casada, -1 = todas ja casadas
+    uint32_t tag;
+} ReferenceSlot;
+
+typedef struct {
+    const char* label; // dentro do arquivo mapeado, sem '\0'
+    int label_len;
+    int cluster;
+    int next;
+} ReferenceLine;
+
+struct CluReference {
+    char* data;
+    size_t size;
+    bool mapped;
+    ReferenceLine* lines;
+    int count;
+    ReferenceSlot* slots;
+    size_t mask;
+};
+
+static size_t reference_slot(const CluReference* reference, const char* label, size_t len, uint32_t* tag){
+    uint64_t hash = hash_label(label, len);
+    size_t slot = hash & reference->mask;
+    *tag = (uint32_t)(hash >> 32);
+    while(reference->slots[slot].first >= 0){
+        const ReferenceSlot* entry = &reference->slots[slot];
+        const ReferenceLine* line = &reference->lines[entry->first];
+        if(entry->tag == *tag && (size_t)line->label_len == len && !memcmp(line->label, label, len)) break;
+        slot = (slot + 1) & reference->mask;
+    }
+    return slot;
+}
+
+CluReference* load_clu_reference(const char* filename){
+    CluReference* reference = calloc(1, sizeof(CluReference));
+    if(!reference) return NULL;
+    reference->data = map_data_file(filename, &reference->size, &reference->mapped);
+    if(!reference->data){
+        printf("Aviso: Não foi possível abrir o arquivo de clusters de referência '%s'.\n", filename);
+        free(reference);
+        return NULL;
+    }
+
+    // Uma linha por '\n' (e a ultima) e o teto de linhas validas
+    size_t capacity = 1;
+    for(const char* c = reference->data; (c = memchr(c, '\n', reference->data + reference->size - c)); c++) capacity++;
+    reference->lines = malloc(sizeof(ReferenceLine) * capacity);
+    size_t table_size = 16;
+    while(table_size < capacity * 2) table_size <<= 1;
+    reference->mask = table_size - 1;
+    reference->slots = malloc(sizeof(ReferenceSlot) * table_size);
+    if(!reference->lines || !reference->slots){
+        perror("Falha ao alocar memória para os clusters de referência");
+        free_clu_reference(reference);
+        return NULL;
+    }
+    for(size_t slot = 0; slot < table_size; slot++) reference->slots[slot].first = -1;
+
+    int lines = 0, malformed = 0;
+    const char* c = reference->data;
+    const char* end = reference->data + reference->size;
+    // Ultima linha de cada rotulo, para a fila seguir a ordem do arquivo
+    int* tails = malloc(sizeof(int) * table_size);
+    if(!tails){
+        perror("Falha ao alocar memória para os clusters de referência");
+        free_clu_reference(reference);
+        return NULL;
+    }
+    while(c < end){
+        const char* line_end = memchr(c, '\n', end - c);
+        if(!line_end) line_end = end;
+        const char* next = line_end < end ? line_end + 1 : end;
+        if(line_end > c && line_end[-1] == '\r') line_end--;
+        lines++;
+
+        const char* label;
+        size_t label_len;
+        int cluster;
+        int parsed = parse_clu_line(c, line_end, &label, &label_len, &cluster);
+        c = next;
+        if(parsed < 0 && lines > 1){
+            if(malformed < MAX_REPORTED_LINES)
+                fprintf(stderr, "Aviso: Linha %d mal formatada no arquivo de referência %s\n", lines, filename);
+            malformed++;
+        }
+        if(parsed <= 0) continue;
+
+        int index = reference->count++;
+        ReferenceLine* line = &reference->lines[index];
+        line->label = label;
+        line->label_len = (int)label_len;
+        line->cluster = cluster;
+        line->next = -1;
+
+        uint32_t tag;
+        size_t slot = reference_slot(reference, label, label_len, &tag);
+        ReferenceSlot* entry = &reference->slots[slot];
+        if(entry->first < 0){
+            entry->first = entry->head = index;
+            entry->tag = tag;
+        } else reference->lines[tails[slot]].next = index;
+        tails[slot] = index;
+    }
+    free(tails);
+
+    if(malformed > MAX_REPORTED_LINES)
+        fprintf(stderr, "Aviso: %d linhas mal formatadas em %s no total.\n", malformed, filename);
+    return reference;
+}
+
+int take_reference_cluster(CluReference* reference, const char* label){
+    size_t len = strnlen(label, MAX_LABEL_LEN - 1);
+    uint32_t tag;
+    ReferenceSlot* entry = &reference->slots[reference_slot(reference, label, len, &tag)];
+    if(entry->first < 0 || entry->head < 0) return -1;
+    int line = entry->head;
+    entry->head = reference->lines[line].next;
+    return reference->lines[line].cluster;
+}
+
+void reset_clu_reference(CluReference* reference){
+    for(size_t slot = 0; slot <= reference->mask; slot++)
+        reference->slots[slot].head = reference->slots[slot].first;
+}
+
+void free_clu_reference(CluReference* reference){
+    if(!reference) return;
+    free(reference->lines);
+    free(reference->slots);
+    unmap_data_file(reference->data, reference->size, reference->mapped);
+    free(reference);
+}
+
+void free_clusters(int* clusters){
+    free(clusters);
+}
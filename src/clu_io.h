@@ -0,0 +1,60 @@
+/* date = October 17th 2026 6:10 pm */
+
+#ifndef CLU_IO_H
+#define CLU_IO_H
+
+#include <stddef.h>
+#include "data_loader.h"
+
+// Arquivos .clu: uma linha "rotulo\tcluster" por ponto. A escrita monta as linhas num
+// buffer grande, com os inteiros formatados a mao; a leitura mapeia o arquivo e aceita
+// (e pula) uma linha de cabecalho.
+
+// Pasta padrao dos gabaritos e dos resultados
+#define CLU_RESULTS_DIR "../data/resultados"
+
+// Caminho do resultado: <output_dir>/G1_<dataset>_<algoritmo>_<k>.clu
+void clu_result_path(char* path, size_t size, const char* output_dir, const char* dataset_name,
+                     int chosen_algorithm, int k);
+
+// Grava os rotulos cluster_id (um por ponto do dataset) em path. Devolve 0 se falhar.
+int write_clusters(const DataSet* dataset, const int* cluster_id, const char* path);
+
+void write_clu(DataSet* dataset, char* dataset_name, int k, int chosen_algorithm);
+
+// Escrita aos poucos, lote a lote (ver DataReader): mesmo formato do write_clusters
+typedef struct CluFile CluFile;
+
+CluFile* create_clu_file(const char* path);
+
+// Acrescenta uma linha por ponto do dataset. Devolve 0 se a escrita ja falhou.
+int append_clusters(CluFile* clu, const DataSet* dataset, const int* cluster_id);
+
+// Grava o que falta e fecha; devolve 0 se alguma escrita falhou
+int close_clu_file(CluFile* clu);
+
+// Clusters na ordem das linhas do arquivo (posicional)
+int* load_clusters(const char* filename, int num_points);
+
+// Clusters casados pelo rotulo de cada ponto do dataset, em qualquer ordem. Pontos que
+// nao aparecem no arquivo ficam com -1.
+int* load_clusters_for_dataset(const char* filename, const DataSet* dataset);
+
+// Gabarito indexado pelo rotulo, para avaliar pontos que chegam em lotes sem ter o
+// dataset inteiro: o arquivo fica mapeado e o indice guarda poucos bytes por linha.
+typedef struct CluReference CluReference;
+
+CluReference* load_clu_reference(const char* filename);
+
+// Cluster da proxima linha com esse rotulo (rotulos repetidos saem na ordem do arquivo);
+// -1 se nao houver mais nenhuma
+int take_reference_cluster(CluReference* reference, const char* label);
+
+// Volta todos os rotulos para a primeira linha, para casar os pontos de novo
+void reset_clu_reference(CluReference* reference);
+
+void free_clu_reference(CluReference* reference);
+
+void free_clusters(int* clusters);
+
+#endif // CLU_IO_H
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cluster_writer.h"
+#include "clu_io.h"
+
+// Resultados esperando gravacao; limita a memoria das copias dos rotulos
+#define MAX_PENDING_WRITES 4
+
+typedef struct {
+    int* cluster_id;
+    char* path;
+} WriteJob;
+
+struct ClusterWriter {
+    const DataSet* dataset;
+    pthread_t thread;
+    bool running; // thread criada; senao grava na hora
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    WriteJob jobs[MAX_PENDING_WRITES]; // fila circular
+    int head;
+    int pending;
+    bool closing;
+    int failures;
+};
+
+static int run_job(ClusterWriter* writer, WriteJob* job){
+    int ok = write_clusters(writer->dataset, job->cluster_id, job->path);
+    free(job->cluster_id);
+    free(job->path);
+    return ok;
+}
+
+static void* writer_thread(void* argument){
+    ClusterWriter* writer = (ClusterWriter*)argument;
+
+    pthread_mutex_lock(&writer->lock);
+    for(;;){
+        while(!writer->pending && !writer->closing) pthread_cond_wait(&writer->changed, &writer->lock);
+        if(!writer->pending) break;
+
+        // Grava fora da trava; o lugar na fila so e liberado depois
+        WriteJob job = writer->jobs[writer->head];
+        pthread_mutex_unlock(&writer->lock);
+        int ok = run_job(writer, &job);
+        pthread_mutex_lock(&writer->lock);
+
+        if(!ok) writer->failures++;
+        writer->head = (writer->head + 1) % MAX_PENDING_WRITES;
+        writer->pending--;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+ClusterWriter* start_cluster_writer(const DataSet* dataset){
+    ClusterWriter* writer = calloc(1, sizeof(ClusterWriter));
+    if(!writer){
+        perror("Falha ao alocar o gravador de clusters");
+        return NULL;
+    }
+    writer->dataset = dataset;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    writer->running = pthread_create(&writer->thread, NULL, writer_thread, writer) == 0;
+    return writer;
+}
+
+void queue_clusters(ClusterWriter* writer, const int* cluster_id, const char* path){
+    WriteJob job;
+    size_t size = sizeof(int) * writer->dataset->count;
+    job.cluster_id = malloc(size ? size : 1);
+    job.path = malloc(strlen(path) + 1);
+    if(!job.cluster_id || !job.path){
+        // Sem memoria para a copia: grava agora mesmo, com os rotulos originais
+        free(job.cluster_id);
+        free(job.path);
+        int ok = write_clusters(writer->dataset, cluster_id, path);
+        pthread_mutex_lock(&writer->lock);
+        if(!ok) writer->failures++;
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+    memcpy(job.cluster_id, cluster_id, size);
+    strcpy(job.path, path);
+
+    if(!writer->running){
+        if(!run_job(writer, &job)) writer->failures++;
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    while(writer->pending == MAX_PENDING_WRITES) pthread_cond_wait(&writer->changed, &writer->lock);
+    writer->jobs[(writer->head + writer->pending) % MAX_PENDING_WRITES] = job;
+    writer->pending++;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+int finish_cluster_writer(ClusterWriter* writer){
+    if(!writer) return 0;
+    if(writer->running){
+        pthread_mutex_lock(&writer->lock);
+        writer->closing = true;
+        pthread_cond_broadcast(&writer->changed);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+    }
+    int failures = writer->failures;
+    pthread_cond_destroy(&writer->changed);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer);
+    return failures;
+}
@@ -0,0 +1,21 @@
+/* date = October 17th 2026 5:20 pm */
+
+#ifndef CLUSTER_WRITER_H
+#define CLUSTER_WRITER_H
+
+#include "data_loader.h"
+
+// Grava arquivos .clu numa thread de fundo, para a escrita em disco se sobrepor ao
+// calculo do proximo k. Cada pedido leva uma copia dos rotulos; com a fila cheia, quem
+// pede espera. O dataset (rotulos dos pontos) precisa existir ate o fim da thread.
+typedef struct ClusterWriter ClusterWriter;
+
+ClusterWriter* start_cluster_writer(const DataSet* dataset);
+
+// Agenda a gravacao dos rotulos cluster_id (um por ponto do dataset) em path
+void queue_clusters(ClusterWriter* writer, const int* cluster_id, const char* path);
+
+// Espera a fila esvaziar e encerra a thread. Devolve quantas gravacoes falharam.
+int finish_cluster_writer(ClusterWriter* writer);
+
+#endif // CLUSTER_WRITER_H
@@ -1,331 +1,1540 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <time.h>
 #include "clustering.h"
+#include "parallel.h"
+#include "distance.h"
+#include "stats.h"
 
-double squared_distance(DataPoint* p1, DataPoint* p2){
-    return pow(p1->d1 - p2->d1, 2) + pow(p1->d2 - p2->d2, 2);
-}
+// Folga relativa aplicada a todo limite do k-medias acelerado: cobre o arredondamento das
+// distancias, entao um centroide so e pulado se estiver mesmo mais longe
+#define BOUND_SLACK 1e-9
+// Abaixo disso o Hamerly (um limite por ponto) ganha do Elkan
+#define ELKAN_MIN_K 32
+// Teto de memoria dos limites do Elkan; acima disso usa o Hamerly
+#define ELKAN_MAX_BYTES ((size_t)1 << 30)
+// A partir daqui o KMEANS_SEED_AUTO troca o k-means++ (k passadas) pelo k-means||
+#define KMEANS_PARALLEL_MIN_COUNT 100000
+// k-means||: passadas de amostragem e candidatos sorteados por passada (em multiplos de k)
+#define KMEANS_PARALLEL_ROUNDS 5
+#define KMEANS_PARALLEL_OVERSAMPLING 2
 
 void uncluster(DataSet* dataset){
-    for(int i = 0; i < dataset->count; i++)
-        dataset->points[i].cluster_id = 0;
+    memset(dataset->cluster_id, 0, sizeof(int) * dataset->count);
 }
 
-DataPoint* centroids(DataSet* dataset, int n_clusters){
-    DataPoint* centroid_points = malloc(sizeof(DataPoint) * n_clusters);
-    
-    double* d1_sums = malloc(sizeof(double) * n_clusters);
-    double* d2_sums = malloc(sizeof(double) * n_clusters);
-    int* sizes = malloc(sizeof(int) * n_clusters);
-    
-    memset(sizes, 0, sizeof(int) * n_clusters);
-    memset(d1_sums, 0, sizeof(double) * n_clusters);
-    memset(d2_sums, 0, sizeof(double) * n_clusters);
-    
-    for(int i = 0; i < dataset->count; i++){
-        int i_cluster = dataset->points[i].cluster_id;
-        d1_sums[i_cluster] += dataset->points[i].d1;
-        d2_sums[i_cluster] += dataset->points[i].d2;
-        sizes[i_cluster]++;
+// Coordenadas do ponto i num vetor contiguo (entrada dos kernels de distancia)
+static void gather_point(const DataSet* dataset, int i, double* point){
+    for(int d = 0; d < dataset->dims; d++) point[d] = dataset->columns[d][i];
+}
+
+static void gather_point_columns(double** columns, int dims, int i, double* point){
+    for(int d = 0; d < dims; d++) point[d] = columns[d][i];
+}
+
+// Centroides em colunas: centroid_columns[d][c], como as coordenadas do DataSet
+static double** alloc_centroid_columns(int k, int dims){
+    double** columns = malloc(sizeof(double*) * dims);
+    columns[0] = malloc(sizeof(double) * k * dims);
+    for(int d = 1; d < dims; d++) columns[d] = columns[0] + (size_t)d * k;
+    return columns;
+}
+
+static void free_centroid_columns(double** columns){
+    if(!columns) return;
+    free(columns[0]);
+    free(columns);
+}
+
+KMeansOptions kmeans_default_options(int k, int iteration_limit){
+    KMeansOptions options;
+    options.k = k;
+    options.iteration_limit = iteration_limit;
+    options.n_threads = 1;
+    options.algorithm = KMEANS_AUTO;
+    options.seeding = KMEANS_SEED_SPREAD;
+    options.seed = 1;
+    options.n_restarts = 1;
+    options.progress.callback = NULL;
+    options.progress.data = NULL;
+    options.progress.every = 0;
+    return options;
+}
+
+// Variacao das somas de cada cluster causada pelo bloco de pontos de uma thread: so os
+// pontos que mudaram de cluster entram (na passada inicial, todos). Ficam zeradas entre as
+// iteracoes; a reducao so le e zera os clusters marcados em touched.
+typedef struct {
+    double* sums; // sums[d * k + c]
+    int* sizes;
+    bool* touched; // cluster ganhou ou perdeu algum ponto
+    double* point; // coordenadas do ponto atual
+    double* distances; // distancias do ponto ate os k centroides
+    int moved;
+    double inertia;
+    STATS_ONLY(long long distance_count;) // Hamerly/Elkan: distancias calculadas pela thread
+} KMeansPartial;
+
+// Limites do Hamerly/Elkan, em distancia (nao ao quadrado), sempre arredondados pro lado seguro
+typedef struct {
+    KMeansAlgorithm algorithm;
+    double* upper; // upper[i] >= distancia do ponto i ao seu centroide
+    double* lower; // Hamerly: lower[i] <= distancia ao segundo mais proximo; Elkan: lower[i * k + c]
+    double* drift; // quanto cada centroide andou na ultima atualizacao
+    double max_drift; // maior deslocamento e o segundo maior, para o Hamerly
+    double second_drift;
+    int max_drift_cluster;
+    double* half_gap; // metade da distancia de cada centroide ao centroide mais proximo
+    double* half_distances; // Elkan: metade da distancia entre os centroides a e c, em a * k + c
+    double** previous_columns; // centroides da iteracao anterior
+    bool full_pass; // limites invalidos: calcula todas as distancias
+    STATS_ONLY(long long tracked_bytes;)
+} KMeansBounds;
+
+typedef struct {
+    const DataSet* dataset;
+    int* cluster_id; // rotulos desta execucao (cada reinicio tem os seus)
+    int k;
+    double** centroid_columns;
+    KMeansPartial* partials;
+    KMeansBounds* bounds; // NULL no Lloyd
+    bool assign; // false: so acumula as somas dos rotulos atuais
+} KMeansContext;
+
+static double bound_up(double distance){
+    return distance * (1 + BOUND_SLACK);
+}
+
+static double bound_down(double distance){
+    return distance * (1 - BOUND_SLACK);
+}
+
+// Mesmo criterio do nearest_centroid: menor distancia, empate fica com o de maior indice
+static int closest_of(const double* distances, int k){
+    int closest = 0;
+    for(int c = 1; c < k; c++)
+        if(!(distances[c] > distances[closest])) closest = c;
+    return closest;
+}
+
+static double distance_to_centroid(const KMeansContext* ctx, const double* point, int c){
+    double distance;
+    squared_distances_to_block(point, (const double* const*)ctx->centroid_columns, ctx->dataset->dims, c, 1, &distance);
+    return distance;
+}
+
+// Calcula as k distancias do ponto e refaz todos os seus limites
+static int full_assign(const KMeansContext* ctx, KMeansPartial* partial, int i){
+    KMeansBounds* bounds = ctx->bounds;
+    double* distances = partial->distances;
+    int k = ctx->k;
+
+    squared_distances_to_block(partial->point, (const double* const*)ctx->centroid_columns, ctx->dataset->dims, 0, k, distances);
+    STATS_ONLY(partial->distance_count += k;)
+    int closest = closest_of(distances, k);
+    bounds->upper[i] = bound_up(sqrt(distances[closest]));
+
+    if(bounds->algorithm == KMEANS_ELKAN){
+        double* lower = bounds->lower + (size_t)i * k;
+        for(int c = 0; c < k; c++) lower[c] = bound_down(sqrt(distances[c]));
+    } else {
+        double second = INFINITY;
+        for(int c = 0; c < k; c++)
+            if(c != closest && distances[c] < second) second = distances[c];
+        bounds->lower[i] = bound_down(sqrt(second));
     }
-    
-    for(int i = 0; i < n_clusters; i++){
-        centroid_points[i].d1 = d1_sums[i] / sizes[i];
-        centroid_points[i].d2 = d2_sums[i] / sizes[i];
+    return closest;
+}
+
+// Limite inferior depois de o centroide andar drift
+static double lower_after_drift(double lower, double drift){
+    return lower - drift - BOUND_SLACK * (fabs(lower) + drift);
+}
+
+static int hamerly_assign(const KMeansContext* ctx, KMeansPartial* partial, int i){
+    KMeansBounds* bounds = ctx->bounds;
+    int assigned = ctx->cluster_id[i];
+
+    double other_drift = assigned == bounds->max_drift_cluster ? bounds->second_drift : bounds->max_drift;
+    double upper = bound_up(bounds->upper[i] + bounds->drift[assigned]);
+    double lower = lower_after_drift(bounds->lower[i], other_drift);
+    bounds->lower[i] = lower;
+
+    double limit = bounds->half_gap[assigned] > lower ? bounds->half_gap[assigned] : lower;
+    if(upper < limit){
+        bounds->upper[i] = upper;
+        return assigned;
     }
-    
-    free(d1_sums);
-    free(d2_sums);
-    free(sizes);
-    
-    return centroid_points;
+
+    // Aperta o limite superior com a distancia exata antes de olhar os outros centroides
+    upper = bound_up(sqrt(distance_to_centroid(ctx, partial->point, assigned)));
+    STATS_ONLY(partial->distance_count++;)
+    bounds->upper[i] = upper;
+    if(upper < limit) return assigned;
+
+    return full_assign(ctx, partial, i);
 }
 
-void k_means(DataSet* dataset, int k, int iteration_limit){
-    uncluster(dataset);
-    
-    // Escolhe os pontos iniciais
-    for(int i = 0; i < k; i++){
-        int chosen_index = (dataset->count / (k + 1)) * (i + 1);
-        
-        dataset->points[chosen_index].cluster_id = i;
+static int elkan_assign(const KMeansContext* ctx, KMeansPartial* partial, int i){
+    KMeansBounds* bounds = ctx->bounds;
+    int k = ctx->k;
+    int assigned = ctx->cluster_id[i];
+    double* lower = bounds->lower + (size_t)i * k;
+
+    for(int c = 0; c < k; c++) lower[c] = lower_after_drift(lower[c], bounds->drift[c]);
+    double upper = bound_up(bounds->upper[i] + bounds->drift[assigned]);
+
+    if(upper < bounds->half_gap[assigned]){
+        bounds->upper[i] = upper;
+        return assigned;
     }
-    
-    int converged = 0;
-    int iterations = 0;
-    // Enquanto nao convergir e nao passar do limite
-    while(!converged && iterations < iteration_limit){
-        converged = 1;
-        // Vetor com o centroide de cada cluster
-        DataPoint* centroid_points = centroids(dataset, k);
+
+    bool tight = false;
+    double assigned_distance = 0; // ao quadrado, exata quando tight
+    for(int c = 0; c < k; c++){
+        if(c == assigned) continue;
+        const double* half_distances = bounds->half_distances + (size_t)assigned * k;
+        if(upper < lower[c] || upper < half_distances[c]) continue;
+
+        if(!tight){
+            assigned_distance = distance_to_centroid(ctx, partial->point, assigned);
+            STATS_ONLY(partial->distance_count++;)
+            upper = bound_up(sqrt(assigned_distance));
+            lower[assigned] = bound_down(sqrt(assigned_distance));
+            tight = true;
+            if(upper < lower[c] || upper < half_distances[c]) continue;
+        }
+
+        double distance = distance_to_centroid(ctx, partial->point, c);
+        STATS_ONLY(partial->distance_count++;)
+        lower[c] = bound_down(sqrt(distance));
+        // Compara as distancias exatas com o mesmo desempate do Lloyd
+        if(distance < assigned_distance || (distance == assigned_distance && c > assigned)){
+            assigned = c;
+            assigned_distance = distance;
+            upper = bound_up(sqrt(distance));
+        }
+    }
+
+    bounds->upper[i] = upper;
+    return assigned;
+}
+
+// Atribui cada ponto do bloco ao centroide mais proximo. Um ponto que sai do cluster a
+// para o b so mexe nas somas de a e b, entao no fim da convergencia, quando quase nada
+// muda, a atualizacao custa O(pontos movidos) e nao O(n).
+static void kmeans_task(void* context, int thread_index, int begin, int end){
+    KMeansContext* ctx = (KMeansContext*)context;
+    KMeansPartial* partial = &ctx->partials[thread_index];
+    const DataSet* dataset = ctx->dataset;
+    const double* const* centroid_columns = (const double* const*)ctx->centroid_columns;
+    int* cluster_id = ctx->cluster_id;
+    int dims = dataset->dims;
+    int k = ctx->k;
+
+    partial->moved = 0;
+
+    for(int i = begin; i < end; i++){
+        gather_point(dataset, i, partial->point);
         
-        // Para cada ponto...
-        for(int i = 0; i < dataset->count; i++){
+        if(ctx->assign){
             // Acha o cluster com o centroide mais proximo
-            double smallest_distance = squared_distance(&dataset->points[i], &centroid_points[0]);
-            int closest_cluster = 0;
-            
-            for(int j = 1; j < k; j++){
-                double distance_j = squared_distance(&dataset->points[i], &centroid_points[j]);
-                if(distance_j > smallest_distance) continue;
-                smallest_distance = distance_j;
-                closest_cluster = j;
+            int closest_cluster;
+            if(!ctx->bounds) closest_cluster = nearest_centroid(partial->point, centroid_columns, dims, k, NULL);
+            else if(ctx->bounds->full_pass) closest_cluster = full_assign(ctx, partial, i);
+            else if(ctx->bounds->algorithm == KMEANS_ELKAN) closest_cluster = elkan_assign(ctx, partial, i);
+            else closest_cluster = hamerly_assign(ctx, partial, i);
+
+            int previous = cluster_id[i];
+            if(closest_cluster == previous) continue;
+            cluster_id[i] = closest_cluster;
+            partial->moved++;
+
+            // Rotulo -1: o ponto ainda nao estava em cluster nenhum
+            if(previous >= 0){
+                for(int d = 0; d < dims; d++) partial->sums[(size_t)d * k + previous] -= partial->point[d];
+                partial->sizes[previous]--;
+                partial->touched[previous] = true;
             }
-            
-            // Se nunca passar desse if, convergiu
-            if(closest_cluster == dataset->points[i].cluster_id) continue;
-            
-            dataset->points[i].cluster_id = closest_cluster;
-            converged = 0;
         }
-        
-        iterations++;
-        
-        free(centroid_points);
+
+        int i_cluster = cluster_id[i];
+        for(int d = 0; d < dims; d++) partial->sums[(size_t)d * k + i_cluster] += partial->point[d];
+        partial->sizes[i_cluster]++;
+        partial->touched[i_cluster] = true;
     }
+
+    // Uma soma atomica por bloco; no Lloyd sao sempre k distancias por ponto
+    STATS_ONLY(if(ctx->assign && !ctx->bounds) partial->distance_count += (long long)(end - begin) * k;)
+    STATS_ADD(STAT_DISTANCES, partial->distance_count);
+    STATS_ONLY(partial->distance_count = 0;)
 }
 
-void colour_setting(DataSet* dataset, bool* existing_clusters, int k) {
-	int qtd_points = dataset->count, current_id = 0, iterations = k;
-	
-	for (int i = 0; i < qtd_points; i++) {
-		if (iterations == 0) break;
-		if (existing_clusters[i] == true) {
-			int aux = dataset->points[i].cluster_id;
-			for (int j = 0; j < qtd_points; j++) {
-				if (dataset->points[j].cluster_id == aux)
-					dataset->points[j].cluster_id = current_id;
-			}
-			current_id++;
-			iterations--;
-		}
-	}
+// Soma as variacoes das threads as somas da execucao (sums[d * k + c], sizes[c]), sempre na
+// ordem das threads: mesmo resultado para a mesma quantidade de threads. So os clusters que
+// mudaram sao recalculados; um cluster vazio mantem o centroide onde estava. Devolve
+// quantos pontos mudaram de cluster.
+static int reduce_partials(KMeansPartial* partials, int n_threads, int k, int dims, double* sums, int* sizes, double** centroid_columns){
+    int moved = 0;
+    for(int t = 0; t < n_threads; t++) moved += partials[t].moved;
+
+    for(int i = 0; i < k; i++){
+        bool touched = false;
+        for(int t = 0; t < n_threads; t++) touched |= partials[t].touched[i];
+        if(!touched) continue;
+
+        for(int t = 0; t < n_threads; t++){
+            KMeansPartial* partial = &partials[t];
+            if(!partial->touched[i]) continue;
+            sizes[i] += partial->sizes[i];
+            for(int d = 0; d < dims; d++){
+                sums[(size_t)d * k + i] += partial->sums[(size_t)d * k + i];
+                partial->sums[(size_t)d * k + i] = 0;
+            }
+            partial->sizes[i] = 0;
+            partial->touched[i] = false;
+        }
+
+        if(sizes[i] > 0)
+            for(int d = 0; d < dims; d++) centroid_columns[d][i] = sums[(size_t)d * k + i] / sizes[i];
+    }
+
+    return moved;
 }
 
-void merge_clusters(DataSet* dataset, double** clusters_distance, bool* existing_clusters, int cluster1, int cluster2) {
-    
-	int qtd_points = dataset->count;
-    
-	existing_clusters[cluster2] = false;
-	for (int i = 0; i < qtd_points; i++)
-		if (dataset->points[i].cluster_id == cluster2) dataset->points[i].cluster_id = cluster1;
-	
-	// Atualizando matriz das distancias entre os clusters:
-	for (int i = 0; i < qtd_points; i++) {
-		if (i == cluster1) continue;
-		if (clusters_distance[cluster1][i] < clusters_distance[cluster2][i]) {
-			clusters_distance[cluster1][i] = clusters_distance[cluster2][i];
-			clusters_distance[i][cluster1] = clusters_distance[cluster2][i];
-		}
-	}
-    
+static KMeansPartial* create_partials(int n_threads, int k, int dims){
+    KMeansPartial* partials = malloc(sizeof(KMeansPartial) * n_threads);
+    for(int t = 0; t < n_threads; t++){
+        partials[t].sums = calloc((size_t)k * dims, sizeof(double));
+        partials[t].sizes = calloc(k, sizeof(int));
+        partials[t].touched = calloc(k, sizeof(bool));
+        partials[t].point = malloc(sizeof(double) * dims);
+        partials[t].distances = malloc(sizeof(double) * k);
+        STATS_ONLY(partials[t].distance_count = 0;)
+    }
+    return partials;
 }
 
-void complete_link(DataSet* dataset, int k) {
-	
-	int qtd_points = dataset->count, qtd_clusters = dataset->count;
-	
-	// Cada ponto é um cluster fechado:
-	bool* existing_clusters = (bool*)malloc(sizeof(bool)*qtd_points);
-	for (int i = 0; i < qtd_points; i++) {
-		existing_clusters[i] = true;
-		dataset->points[i].cluster_id = i;
-	}
-	
-	// Array de distancias entres clusters:
-	double** clusters_distance = (double**)malloc(sizeof(double*)*qtd_points);
-	for (int i = 0; i < qtd_points; i++) {
-		clusters_distance[i] = (double*)malloc(sizeof(double)*qtd_points);
-		for (int j = 0; j < qtd_points; j++) clusters_distance[i][j] = squared_distance(&dataset->points[i], &dataset->points[j]);
-	}
-	
-	// Comeco do algoritmo de fato:
-	while(qtd_clusters != k) {
-		
-		double shortest_distance = INFINITY;
-		int cluster1 = -1, cluster2 = -1;
-		
-		// Encontrando a menor distancia max na matriz de distancias dos clusters
-		for (int i = 0; i < qtd_points; i++) {
-			if (existing_clusters[i] == false) continue;
-			for (int j = 0; j < qtd_points; j++) {
-				if (existing_clusters[j] == false || clusters_distance[i][j] == 0) continue;
-				if (clusters_distance[i][j] < shortest_distance) {
-					shortest_distance = clusters_distance[i][j];
-					cluster1 = i;
-					cluster2 = j;
-				}
-			}
-		}
-		merge_clusters(dataset, clusters_distance, existing_clusters, cluster1, cluster2);
-		qtd_clusters--;
-		
-	}
-	
-	// Corrigindo as cores:
-	colour_setting(dataset, existing_clusters, k);
-	
-	// Desalocando a matriz:
-	for (int i = 0; i < qtd_points; i++) free(clusters_distance[i]);
-	free(clusters_distance);
-	free(existing_clusters); // Desalocando existing_clusters
-
-}
-
-void find_closest_points_different_clusters(DataSet* dataset, double** matrix, int* point1_index, int* point2_index) {
-    int quant_points = dataset->count;
-    double min_distance = INFINITY;
-    
-    //acha os pontos mais proximos
-    for (int i = 0; i < quant_points; i++) {
-        for (int j = i + 1; j < quant_points; j++) {
-            if(dataset->points[i].cluster_id == dataset->points[j].cluster_id) continue; //pula pontos do mesmo cluster
-            double distance = matrix[i][j];
-            if (distance >= min_distance) continue; 
-            min_distance = distance;
-            *point1_index = i;
-            *point2_index = j;
+static void free_partials(KMeansPartial* partials, int n_threads){
+    for(int t = 0; t < n_threads; t++){
+        free(partials[t].sums);
+        free(partials[t].sizes);
+        free(partials[t].touched);
+        free(partials[t].point);
+        free(partials[t].distances);
+    }
+    free(partials);
+}
+
+static KMeansAlgorithm choose_kmeans_algorithm(const KMeansOptions* options, int count){
+    KMeansAlgorithm algorithm = options->algorithm;
+    int k = options->k;
+    if(k < 2) return KMEANS_LLOYD;
+    if(algorithm == KMEANS_AUTO) algorithm = k < ELKAN_MIN_K ? KMEANS_HAMERLY : KMEANS_ELKAN;
+    if(algorithm == KMEANS_ELKAN && (size_t)count * k * sizeof(double) > ELKAN_MAX_BYTES) algorithm = KMEANS_HAMERLY;
+    return algorithm;
+}
+
+static KMeansBounds* create_bounds(KMeansAlgorithm algorithm, int count, int k, int dims){
+    KMeansBounds* bounds = calloc(1, sizeof(KMeansBounds));
+    if(!bounds) return NULL;
+    size_t lower_count = algorithm == KMEANS_ELKAN ? (size_t)count * k : (size_t)count;
+    bounds->algorithm = algorithm;
+    bounds->upper = malloc(sizeof(double) * (count > 0 ? count : 1));
+    bounds->lower = malloc(sizeof(double) * (lower_count > 0 ? lower_count : 1));
+    bounds->drift = malloc(sizeof(double) * k);
+    bounds->half_gap = malloc(sizeof(double) * k);
+    bounds->half_distances = malloc(sizeof(double) * (algorithm == KMEANS_ELKAN ? (size_t)k * k : 1));
+    bounds->previous_columns = alloc_centroid_columns(k, dims);
+    bounds->full_pass = true;
+    STATS_ONLY(bounds->tracked_bytes = (long long)sizeof(double) * ((long long)count + (long long)lower_count);)
+    STATS_ALLOC(bounds->tracked_bytes);
+    return bounds;
+}
+
+static void free_bounds(KMeansBounds* bounds){
+    if(!bounds) return;
+    STATS_FREE(bounds->tracked_bytes);
+    free(bounds->upper);
+    free(bounds->lower);
+    free(bounds->drift);
+    free(bounds->half_gap);
+    free(bounds->half_distances);
+    free_centroid_columns(bounds->previous_columns);
+    free(bounds);
+}
+
+static bool bounds_allocated(const KMeansBounds* bounds){
+    return bounds && bounds->upper && bounds->lower && bounds->drift && bounds->half_gap &&
+           bounds->half_distances && bounds->previous_columns && bounds->previous_columns[0];
+}
+
+// Depois de atualizar os centroides: deslocamento de cada um e distancias entre eles
+static void update_bounds(KMeansBounds* bounds, double** centroid_columns, int k, int dims, double* point, double* distances){
+    bool finite = true;
+    bounds->max_drift = bounds->second_drift = 0;
+    bounds->max_drift_cluster = -1;
+
+    for(int c = 0; c < k; c++){
+        double drift = 0;
+        for(int d = 0; d < dims; d++){
+            double diff = centroid_columns[d][c] - bounds->previous_columns[d][c];
+            drift += diff * diff;
+            if(!isfinite(centroid_columns[d][c])) finite = false;
+        }
+        drift = bound_up(sqrt(drift));
+        bounds->drift[c] = drift;
+
+        if(drift > bounds->max_drift){
+            bounds->second_drift = bounds->max_drift;
+            bounds->max_drift = drift;
+            bounds->max_drift_cluster = c;
+        } else if(drift > bounds->second_drift) bounds->second_drift = drift;
+    }
+    memcpy(bounds->previous_columns[0], centroid_columns[0], sizeof(double) * k * dims);
+    STATS_ADD(STAT_DISTANCES, (long long)k * k);
+
+    // Coordenada nao finita nos dados deixa o centroide NaN: ai os limites nao valem e a
+    // proxima passada e completa
+    bounds->full_pass = !finite;
+    if(!finite) return;
+
+    for(int a = 0; a < k; a++){
+        gather_point_columns(centroid_columns, dims, a, point);
+        squared_distances_to_block(point, (const double* const*)centroid_columns, dims, 0, k, distances);
+
+        double nearest = INFINITY;
+        for(int c = 0; c < k; c++){
+            if(c == a) continue;
+            double half = bound_down(sqrt(distances[c])) / 2;
+            if(bounds->algorithm == KMEANS_ELKAN) bounds->half_distances[(size_t)a * k + c] = half;
+            if(half < nearest) nearest = half;
         }
+        bounds->half_gap[a] = nearest;
     }
 }
 
-void merge_clusters_single(DataSet* dataset, int point1_index, int point2_index) {
-    int cluster_apagado = dataset->points[point2_index].cluster_id;
-    for (int i = 0; i < dataset->count; i++) {
-        if(dataset->points[i].cluster_id != cluster_apagado) continue;
-        dataset->points[i].cluster_id = dataset->points[point1_index].cluster_id;
+// splitmix64: gerador pequeno, sem estado global, reproduzivel pela semente
+static uint64_t mix_bits(uint64_t z){
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t next_random(uint64_t* state){
+    *state += 0x9E3779B97F4A7C15ULL;
+    return mix_bits(*state);
+}
+
+// Uniforme em [0, 1)
+static double random_unit(uint64_t* state){
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Centros avaliados de uma vez por ponto na semeadura
+#define SEEDING_BLOCK 256
+
+// Estado da semeadura (k-means++ e k-means||) sobre pontos em colunas. O k-means|| reagrupa
+// os seus candidatos com peso; nos dados originais weights e NULL (peso 1).
+typedef struct {
+    const double* const* columns;
+    int dims;
+    int count;
+    const double* weights;
+    double* min_distance; // distancia ao quadrado de cada ponto ate o centro mais proximo
+    int* nearest; // qual e esse centro, ou NULL se ninguem precisar
+    const double* const* centers; // centros novos da passada atual, em colunas
+    int n_centers;
+    int first_center; // indice do primeiro centro novo (para o nearest)
+    int n_threads;
+    double* partial_cost; // soma de peso * min_distance no bloco de cada thread
+    int* block_begin; // inicio do bloco de cada thread: o sorteio vai direto ao bloco certo
+    double* buffers; // por thread: dims coordenadas + SEEDING_BLOCK distancias
+} Seeding;
+
+static Seeding* create_seeding(const double* const* columns, int dims, int count, const double* weights, int n_threads){
+    Seeding* seeding = calloc(1, sizeof(Seeding));
+    seeding->columns = columns;
+    seeding->dims = dims;
+    seeding->count = count;
+    seeding->weights = weights;
+    seeding->n_threads = n_threads;
+    seeding->min_distance = malloc(sizeof(double) * count);
+    seeding->partial_cost = malloc(sizeof(double) * n_threads);
+    seeding->block_begin = malloc(sizeof(int) * n_threads);
+    seeding->buffers = malloc(sizeof(double) * n_threads * (dims + SEEDING_BLOCK));
+    for(int i = 0; i < count; i++) seeding->min_distance[i] = INFINITY;
+    return seeding;
+}
+
+static void free_seeding(Seeding* seeding){
+    free(seeding->min_distance);
+    free(seeding->nearest);
+    free(seeding->partial_cost);
+    free(seeding->block_begin);
+    free(seeding->buffers);
+    free(seeding);
+}
+
+static void seeding_task(void* context, int thread_index, int begin, int end){
+    Seeding* seeding = (Seeding*)context;
+    int dims = seeding->dims;
+    double* point = seeding->buffers + (size_t)thread_index * (dims + SEEDING_BLOCK);
+    double* distances = point + dims;
+    double cost = 0;
+
+    for(int i = begin; i < end; i++){
+        for(int d = 0; d < dims; d++) point[d] = seeding->columns[d][i];
+
+        for(int start = 0; start < seeding->n_centers; start += SEEDING_BLOCK){
+            int m = seeding->n_centers - start < SEEDING_BLOCK ? seeding->n_centers - start : SEEDING_BLOCK;
+            squared_distances_to_block(point, seeding->centers, dims, start, m, distances);
+            for(int j = 0; j < m; j++){
+                if(!(distances[j] < seeding->min_distance[i])) continue;
+                seeding->min_distance[i] = distances[j];
+                if(seeding->nearest) seeding->nearest[i] = seeding->first_center + start + j;
+            }
+        }
+        cost += (seeding->weights ? seeding->weights[i] : 1) * seeding->min_distance[i];
     }
+
+    seeding->partial_cost[thread_index] = cost;
+    seeding->block_begin[thread_index] = begin;
 }
 
-void single_link(DataSet* dataset, int k) {
-    uncluster(dataset);
-    
-    int quant_clusters = dataset->count;
-    
-    //cada ponto começa como um cluster
-	for (int i = 0; i < dataset->count; i++)
-		dataset->points[i].cluster_id = i;
-    
-    //cria matriz de distancias entre pontos
-	double** distance_matrix = (double**) malloc(sizeof(double*) * quant_clusters);
-	for (int i = 0; i < quant_clusters; i++) {
-		distance_matrix[i] = (double*) malloc(sizeof(double) * quant_clusters);
-		for (int j = 0; j < quant_clusters; j++) 
-            distance_matrix[i][j] = squared_distance(&dataset->points[i], &dataset->points[j]);
-	}
-    
-    //reduz quant_clusters até k fazendo junção
-    while(quant_clusters != k) {
-		int point1_index = -1, point2_index = -1;
-        find_closest_points_different_clusters(dataset, distance_matrix, &point1_index, &point2_index);
-        merge_clusters_single(dataset, point1_index, point2_index);
-        quant_clusters--;
+// Aproxima todos os pontos dos centros novos e devolve o custo total
+static double seeding_update(Seeding* seeding, double** centers, int n_centers, int first_center){
+    seeding->centers = (const double* const*)centers;
+    seeding->n_centers = n_centers;
+    seeding->first_center = first_center;
+    parallel_for(seeding->n_threads, seeding->count, seeding_task, seeding);
+    STATS_ADD(STAT_DISTANCES, (long long)seeding->count * n_centers);
+
+    double total = 0;
+    for(int t = 0; t < seeding->n_threads; t++) total += seeding->partial_cost[t];
+    return total;
+}
+
+static double seeding_weight(const Seeding* seeding, int i){
+    return (seeding->weights ? seeding->weights[i] : 1) * seeding->min_distance[i];
+}
+
+// Sorteia um ponto com probabilidade proporcional a peso * min_distance
+static int seeding_sample(const Seeding* seeding, double total, uint64_t* rng){
+    // Todos os pontos ja coincidem com algum centro
+    if(!(total > 0)) return (int)(next_random(rng) % (uint64_t)seeding->count);
+
+    double target = random_unit(rng) * total;
+    int t = 0;
+    while(t < seeding->n_threads - 1 && target >= seeding->partial_cost[t]){
+        target -= seeding->partial_cost[t];
+        t++;
     }
-    
-    // Deixando os clusters com as corzinha tudo certo:
-    int* new_cluster_id_hash = malloc(sizeof(int) * dataset->count);
-    for (int i = 0; i < dataset->count; i++) {
-        new_cluster_id_hash[i] = -1;
+
+    int end = t + 1 < seeding->n_threads ? seeding->block_begin[t + 1] : seeding->count;
+    int chosen = -1;
+    for(int i = seeding->block_begin[t]; i < end; i++){
+        double weight = seeding_weight(seeding, i);
+        if(!(weight > 0)) continue;
+        chosen = i;
+        if(target < weight) break;
+        target -= weight;
     }
-    
-    for (int i = 0, k = 0; i < dataset->count; i++) {
-        if(new_cluster_id_hash[dataset->points[i].cluster_id] != -1) continue;
-        new_cluster_id_hash[dataset->points[i].cluster_id] = k;
-        k++;
+
+    // Arredondamento da soma: fica com o ultimo ponto de peso positivo
+    for(int i = seeding->count - 1; chosen < 0 && i >= 0; i--)
+        if(seeding_weight(seeding, i) > 0) chosen = i;
+    return chosen;
+}
+
+// Primeiro centro: proporcional ao peso (uniforme sem pesos)
+static int seeding_first(const Seeding* seeding, uint64_t* rng){
+    if(!seeding->weights) return (int)(next_random(rng) % (uint64_t)seeding->count);
+
+    double total = 0;
+    for(int i = 0; i < seeding->count; i++) total += seeding->weights[i];
+    double target = random_unit(rng) * total;
+    for(int i = 0; i < seeding->count; i++){
+        if(target < seeding->weights[i]) return i;
+        target -= seeding->weights[i];
     }
-    
-    for (int i = 0; i < dataset->count; i++) {
-        dataset->points[i].cluster_id = new_cluster_id_hash[dataset->points[i].cluster_id];
+    return seeding->count - 1;
+}
+
+// Coordenadas dos pontos indices[0..m) como centros em colunas
+static double** gather_centers(const Seeding* seeding, const int* indices, int m){
+    double** centers = alloc_centroid_columns(m, seeding->dims);
+    for(int d = 0; d < seeding->dims; d++)
+        for(int j = 0; j < m; j++) centers[d][j] = seeding->columns[d][indices[j]];
+    return centers;
+}
+
+// k-means++: cada centro novo e sorteado com probabilidade proporcional a distancia ao
+// quadrado ate o centro mais proximo ja escolhido. Guarda os indices dos k pontos em chosen.
+static void kmeans_plus_plus(Seeding* seeding, int k, uint64_t* rng, int* chosen){
+    chosen[0] = seeding_first(seeding, rng);
+    for(int c = 1; c < k; c++){
+        double** center = gather_centers(seeding, &chosen[c - 1], 1);
+        double total = seeding_update(seeding, center, 1, c - 1);
+        free_centroid_columns(center);
+        chosen[c] = seeding_sample(seeding, total, rng);
+    }
+}
+
+// k-means|| (Bahmani et al.): em poucas passadas sorteia cada ponto com probabilidade
+// l * distancia / custo, l = 2k, e depois reduz os candidatos a k com o k-means++
+// ponderado pela quantidade de pontos mais proximos de cada um.
+static void kmeans_parallel_seeding(const DataSet* dataset, int k, int n_threads, uint64_t* rng, int* chosen){
+    int count = dataset->count;
+    Seeding* seeding = create_seeding((const double* const*)dataset->columns, dataset->dims, count, NULL, n_threads);
+    seeding->nearest = malloc(sizeof(int) * count);
+
+    int capacity = 1 + KMEANS_PARALLEL_ROUNDS * KMEANS_PARALLEL_OVERSAMPLING * k;
+    int* candidates = malloc(sizeof(int) * capacity);
+    int n_candidates = 0;
+    candidates[n_candidates++] = seeding_first(seeding, rng);
+
+    double oversampling = (double)KMEANS_PARALLEL_OVERSAMPLING * k;
+    int round_begin = 0;
+    for(int round = 0; ; round++){
+        // Mede os pontos so contra os candidatos sorteados na passada anterior
+        double** centers = gather_centers(seeding, candidates + round_begin, n_candidates - round_begin);
+        double cost = seeding_update(seeding, centers, n_candidates - round_begin, round_begin);
+        free_centroid_columns(centers);
+        if(round == KMEANS_PARALLEL_ROUNDS || !(cost > 0)) break;
+
+        round_begin = n_candidates;
+        for(int i = 0; i < count; i++){
+            if(!(random_unit(rng) < oversampling * seeding->min_distance[i] / cost)) continue;
+            if(n_candidates == capacity){
+                capacity *= 2;
+                candidates = realloc(candidates, sizeof(int) * capacity);
+            }
+            candidates[n_candidates++] = i;
+        }
+        if(n_candidates == round_begin) break;
+    }
+
+    if(n_candidates <= k){
+        // Poucos candidatos (pontos repetidos ou k grande demais): k-means++ direto
+        free_seeding(seeding);
+        free(candidates);
+        seeding = create_seeding((const double* const*)dataset->columns, dataset->dims, count, NULL, n_threads);
+        kmeans_plus_plus(seeding, k, rng, chosen);
+        free_seeding(seeding);
+        return;
+    }
+
+    double* weights = calloc(n_candidates, sizeof(double));
+    for(int i = 0; i < count; i++) weights[seeding->nearest[i]]++;
+
+    double** candidate_columns = gather_centers(seeding, candidates, n_candidates);
+    Seeding* reduction = create_seeding((const double* const*)candidate_columns, dataset->dims, n_candidates, weights, n_threads);
+    int* picked = malloc(sizeof(int) * k);
+    kmeans_plus_plus(reduction, k, rng, picked);
+    for(int c = 0; c < k; c++) chosen[c] = candidates[picked[c]];
+
+    free(picked);
+    free_seeding(reduction);
+    free_centroid_columns(candidate_columns);
+    free(weights);
+    free(candidates);
+    free_seeding(seeding);
+}
+
+static void choose_seeds(const DataSet* dataset, KMeansSeeding seeding_kind, int k, int n_threads, uint64_t seed, int* chosen){
+    uint64_t rng = seed;
+    if(seeding_kind == KMEANS_SEED_AUTO)
+        seeding_kind = dataset->count < KMEANS_PARALLEL_MIN_COUNT ? KMEANS_SEED_PLUS_PLUS : KMEANS_SEED_PARALLEL;
+
+    if(seeding_kind == KMEANS_SEED_PARALLEL){
+        kmeans_parallel_seeding(dataset, k, n_threads, &rng, chosen);
+        return;
+    }
+
+    Seeding* seeding = create_seeding((const double* const*)dataset->columns, dataset->dims, dataset->count, NULL, n_threads);
+    kmeans_plus_plus(seeding, k, &rng, chosen);
+    free_seeding(seeding);
+}
+
+// Distancia ao quadrado de cada ponto ao centroide do seu cluster, somada por thread
+static void inertia_task(void* context, int thread_index, int begin, int end){
+    KMeansContext* ctx = (KMeansContext*)context;
+    KMeansPartial* partial = &ctx->partials[thread_index];
+
+    partial->inertia = 0;
+    for(int i = begin; i < end; i++){
+        gather_point(ctx->dataset, i, partial->point);
+        partial->inertia += distance_to_centroid(ctx, partial->point, ctx->cluster_id[i]);
+    }
+}
+
+// Uma execucao completa do k-medias, com os rotulos em cluster_id. Devolve a inercia.
+// Com progress, chama o acompanhamento a cada iteracao; se ele pedir para parar, marca stopped.
+static double kmeans_run(const DataSet* dataset, int* cluster_id, const KMeansOptions* options, int n_threads, uint64_t seed,
+                         const ClusteringProgress* progress, bool* stopped){
+    int k = options->k;
+    int dims = dataset->dims;
+    if(n_threads > dataset->count) n_threads = dataset->count > 0 ? dataset->count : 1;
+
+    // Buffers alocados uma vez por execucao
+    double** centroid_columns = alloc_centroid_columns(k, dims);
+    KMeansPartial* partials = create_partials(n_threads, k, dims);
+    double* sums = calloc((size_t)k * dims, sizeof(double));
+    int* sizes = calloc(k, sizeof(int));
+
+    KMeansAlgorithm algorithm = choose_kmeans_algorithm(options, dataset->count);
+    KMeansBounds* bounds = NULL;
+    if(algorithm != KMEANS_LLOYD){
+        bounds = create_bounds(algorithm, dataset->count, k, dims);
+        if(!bounds_allocated(bounds)){
+            // Sem memoria para os limites: o Lloyd da o mesmo resultado
+            free_bounds(bounds);
+            bounds = NULL;
+        }
+    }
+
+    KMeansContext context;
+    context.dataset = dataset;
+    context.cluster_id = cluster_id;
+    context.k = k;
+    context.centroid_columns = centroid_columns;
+    context.partials = partials;
+    context.bounds = bounds;
+
+    STATS_TIMER_BEGIN(seeding_start);
+    int iteration_limit = options->iteration_limit;
+    if(options->seeding == KMEANS_SEED_SPREAD){
+        memset(cluster_id, 0, sizeof(int) * dataset->count);
+
+        // Escolhe os pontos iniciais; se um cluster ficar vazio (k perto de n), o
+        // centroide dele fica no seu ponto inicial
+        for(int i = 0; i < k; i++){
+            int chosen_index = (dataset->count / (k + 1)) * (i + 1);
+
+            cluster_id[chosen_index] = i;
+            for(int d = 0; d < dims; d++) centroid_columns[d][i] = dataset->columns[d][chosen_index];
+        }
+
+        // Centroides dos rotulos iniciais
+        context.assign = false;
+        parallel_for(n_threads, dataset->count, kmeans_task, &context);
+        reduce_partials(partials, n_threads, k, dims, sums, sizes, centroid_columns);
+    } else {
+        int* chosen = malloc(sizeof(int) * k);
+        choose_seeds(dataset, options->seeding, k, n_threads, seed, chosen);
+        for(int d = 0; d < dims; d++)
+            for(int c = 0; c < k; c++) centroid_columns[d][c] = dataset->columns[d][chosen[c]];
+        free(chosen);
+
+        // Sem rotulo ainda: todo ponto conta como movido na primeira atribuicao,
+        // que precisa acontecer para haver rotulos
+        for(int i = 0; i < dataset->count; i++) cluster_id[i] = -1;
+        if(iteration_limit < 1) iteration_limit = 1;
+    }
+    if(bounds) memcpy(bounds->previous_columns[0], centroid_columns[0], sizeof(double) * k * dims);
+    STATS_TIMER_END(TIMER_KMEANS_SEEDING, seeding_start);
+
+    STATS_TIMER_BEGIN(iterations_start);
+    int converged = 0;
+    int iterations = 0;
+    bool interrupted = false;
+    context.assign = true;
+    // Enquanto nao convergir e nao passar do limite
+    while(!converged && !interrupted && iterations < iteration_limit){
+        parallel_for(n_threads, dataset->count, kmeans_task, &context);
+
+        // Se nenhum ponto mudou, convergiu
+        int moved = reduce_partials(partials, n_threads, k, dims, sums, sizes, centroid_columns);
+        converged = moved == 0;
+        STATS_ADD(STAT_MOVED_POINTS, moved);
+        if(bounds) update_bounds(bounds, centroid_columns, k, dims, partials[0].point, partials[0].distances);
+        iterations++;
+        if(progress && !progress->callback(progress->data, cluster_id, dataset->count, iterations)) interrupted = true;
     }
+    if(stopped) *stopped = interrupted;
+    STATS_TIMER_END(TIMER_KMEANS_ITERATIONS, iterations_start);
+    STATS_ADD(STAT_KMEANS_RUNS, 1);
+    STATS_ADD(STAT_KMEANS_ITERATIONS, iterations);
+    STATS_ADD(STAT_KMEANS_LIMIT_HITS, !converged && !interrupted);
+
+    parallel_for(n_threads, dataset->count, inertia_task, &context);
+    STATS_ADD(STAT_DISTANCES, dataset->count);
+    double inertia = 0;
+    for(int t = 0; t < n_threads; t++) inertia += partials[t].inertia;
+
+    free_partials(partials, n_threads);
+    free(sums);
+    free(sizes);
+    free_bounds(bounds);
+    free_centroid_columns(centroid_columns);
+    return inertia;
+}
+
+// Reinicios independentes: cada thread de fora roda o seu bloco de reinicios em sequencia
+// (com n_threads threads cada) e guarda so o melhor, entao a memoria e de dois vetores de
+// rotulos por thread, nao por reinicio.
+typedef struct {
+    const DataSet* dataset;
+    const KMeansOptions* options;
+    int n_threads; // threads de cada reinicio
+    int** best_ids; // rotulos do melhor reinicio de cada thread
+    int** scratch_ids;
+    double* best_inertia;
+    int* best_restart;
+    int stopped; // o acompanhamento pediu para parar: ninguem comeca outro reinicio
+} KMeansRestarts;
+
+// Semente do reinicio r, independente das dos outros
+static uint64_t restart_seed(unsigned long long seed, int restart){
+    return mix_bits((uint64_t)seed ^ mix_bits((uint64_t)restart + 1));
+}
+
+static void restarts_task(void* context, int thread_index, int begin, int end){
+    KMeansRestarts* restarts = (KMeansRestarts*)context;
+    restarts->best_restart[thread_index] = -1;
+
+    // Um produtor so para o acompanhamento: os reinicios da primeira thread
+    const ClusteringProgress* progress = thread_index == 0 && restarts->options->progress.callback ?
+        &restarts->options->progress : NULL;
     
-    for(int i = 0; i < dataset->count; i++) free(distance_matrix[i]);
-    free(distance_matrix);
-    free(new_cluster_id_hash);
+    for(int r = begin; r < end && !__atomic_load_n(&restarts->stopped, __ATOMIC_RELAXED); r++){
+        int* labels = restarts->scratch_ids[thread_index];
+        bool stopped = false;
+        double inertia = kmeans_run(restarts->dataset, labels, restarts->options, restarts->n_threads,
+                                    restart_seed(restarts->options->seed, r), progress, &stopped);
+        if(stopped) __atomic_store_n(&restarts->stopped, 1, __ATOMIC_RELAXED);
+
+        if(restarts->best_restart[thread_index] < 0 || inertia < restarts->best_inertia[thread_index]){
+            restarts->scratch_ids[thread_index] = restarts->best_ids[thread_index];
+            restarts->best_ids[thread_index] = labels;
+            restarts->best_inertia[thread_index] = inertia;
+            restarts->best_restart[thread_index] = r;
+        }
+    }
 }
 
-long long combinations(int n, int k) {
-    if (k < 0 || k > n) {
-        return 0;
+double k_means_with_options(DataSet* dataset, const KMeansOptions* options){
+    int n_threads = options->n_threads > 0 ? options->n_threads : available_threads();
+    int n_restarts = options->n_restarts > 1 ? options->n_restarts : 1;
+    // A inicializacao espalhada nao sorteia nada: todo reinicio daria o mesmo resultado
+    if(options->seeding == KMEANS_SEED_SPREAD) n_restarts = 1;
+
+    if(n_restarts == 1)
+        return kmeans_run(dataset, dataset->cluster_id, options, n_threads, restart_seed(options->seed, 0),
+                          options->progress.callback ? &options->progress : NULL, NULL);
+
+    int outer_threads = n_threads < n_restarts ? n_threads : n_restarts;
+    KMeansRestarts restarts;
+    restarts.dataset = dataset;
+    restarts.options = options;
+    restarts.n_threads = n_threads / outer_threads;
+    restarts.best_ids = malloc(sizeof(int*) * outer_threads);
+    restarts.scratch_ids = malloc(sizeof(int*) * outer_threads);
+    restarts.best_inertia = malloc(sizeof(double) * outer_threads);
+    restarts.best_restart = malloc(sizeof(int) * outer_threads);
+    restarts.stopped = 0;
+    for(int t = 0; t < outer_threads; t++){
+        restarts.best_ids[t] = malloc(sizeof(int) * dataset->count);
+        restarts.scratch_ids[t] = malloc(sizeof(int) * dataset->count);
     }
-    if (k == 0 || k == n) {
-        return 1;
+    STATS_ALLOC(2 * sizeof(int) * (size_t)outer_threads * dataset->count);
+
+    parallel_for(outer_threads, n_restarts, restarts_task, &restarts);
+
+    // Menor inercia; empate fica com o reinicio de menor indice
+    int best = 0;
+    for(int t = 1; t < outer_threads; t++){
+        if(restarts.best_restart[t] < 0) continue;
+        if(restarts.best_inertia[t] < restarts.best_inertia[best]) best = t;
     }
-    if (k > n / 2) {
-        k = n - k;
+    memcpy(dataset->cluster_id, restarts.best_ids[best], sizeof(int) * dataset->count);
+    double inertia = restarts.best_inertia[best];
+
+    for(int t = 0; t < outer_threads; t++){
+        free(restarts.best_ids[t]);
+        free(restarts.scratch_ids[t]);
     }
-    if (k != 2) { 
-        return 0;
+    STATS_FREE(2 * sizeof(int) * (size_t)outer_threads * dataset->count);
+    free(restarts.best_ids);
+    free(restarts.scratch_ids);
+    free(restarts.best_inertia);
+    free(restarts.best_restart);
+    return inertia;
+}
+
+void k_means(DataSet* dataset, int k, int iteration_limit){
+    KMeansOptions options = kmeans_default_options(k, iteration_limit);
+    k_means_with_options(dataset, &options);
+}
+
+MiniBatchOptions mini_batch_default_options(int k, int batch_size, int iteration_limit){
+    MiniBatchOptions options;
+    options.k = k;
+    options.batch_size = batch_size;
+    options.iteration_limit = iteration_limit;
+    options.n_threads = 1;
+    options.seed = 1;
+    return options;
+}
+
+KMeansModel* kmeans_model_from_batch(const DataSet* batch, int k, int n_threads, unsigned long long seed){
+    if(batch->count < 1 || k < 1) return NULL;
+    if(n_threads < 1) n_threads = available_threads();
+    if(n_threads > batch->count) n_threads = batch->count;
+
+    KMeansModel* model = malloc(sizeof(KMeansModel));
+    model->k = k;
+    model->dims = batch->dims;
+    model->centroid_columns = alloc_centroid_columns(k, batch->dims);
+    model->counts = calloc(k, sizeof(long long));
+
+    // Centroides iniciais: k-means++ sobre o lote
+    int* chosen = malloc(sizeof(int) * k);
+    uint64_t rng = restart_seed(seed, 0);
+    Seeding* seeding = create_seeding((const double* const*)batch->columns, batch->dims, batch->count, NULL, n_threads);
+    kmeans_plus_plus(seeding, k, &rng, chosen);
+    free_seeding(seeding);
+    for(int d = 0; d < batch->dims; d++)
+        for(int c = 0; c < k; c++) model->centroid_columns[d][c] = batch->columns[d][chosen[c]];
+    free(chosen);
+
+    return model;
+}
+
+void free_kmeans_model(KMeansModel* model){
+    if(!model) return;
+    free_centroid_columns(model->centroid_columns);
+    free(model->counts);
+    free(model);
+}
+
+// Atribui o lote e, se learn, move cada centroide para a media de tudo que ele ja absorveu:
+// centroide += (soma do lote - n * centroide) / contagem, o mesmo que atualizar ponto a ponto
+// com taxa 1 / contagem, mas com a atribuicao em paralelo. partials sao buffers por thread
+// reaproveitados entre passos (ao menos n_threads, zerados aqui); NULL aloca so para este passo.
+static void kmeans_model_step(KMeansModel* model, DataSet* batch, int n_threads, bool learn, KMeansPartial* partials){
+    if(batch->count < 1 || batch->dims != model->dims) return;
+    if(n_threads < 1) n_threads = available_threads();
+    if(n_threads > batch->count) n_threads = batch->count;
+
+    int k = model->k;
+    int dims = model->dims;
+    KMeansPartial* own_partials = partials ? NULL : create_partials(n_threads, k, dims);
+    if(partials){
+        for(int t = 0; t < n_threads; t++){
+            memset(partials[t].sums, 0, sizeof(double) * k * dims);
+            memset(partials[t].sizes, 0, sizeof(int) * k);
+            memset(partials[t].touched, 0, sizeof(bool) * k);
+        }
+    } else partials = own_partials;
+    for(int i = 0; i < batch->count; i++) batch->cluster_id[i] = -1;
+
+    KMeansContext context;
+    context.dataset = batch;
+    context.cluster_id = batch->cluster_id;
+    context.k = k;
+    context.centroid_columns = model->centroid_columns;
+    context.partials = partials;
+    context.bounds = NULL;
+    context.assign = true;
+    parallel_for(n_threads, batch->count, kmeans_task, &context);
+
+    if(learn) STATS_ADD(STAT_MINI_BATCHES, 1);
+    for(int c = 0; learn && c < k; c++){
+        int size = 0;
+        for(int t = 0; t < n_threads; t++) size += partials[t].sizes[c];
+        if(!size) continue;
+
+        model->counts[c] += size;
+        for(int d = 0; d < dims; d++){
+            double sum = 0;
+            for(int t = 0; t < n_threads; t++) sum += partials[t].sums[(size_t)d * k + c];
+            model->centroid_columns[d][c] += (sum - size * model->centroid_columns[d][c]) / model->counts[c];
+        }
     }
-    return (long long)n * (n - 1) / 2;
+
+    if(own_partials) free_partials(own_partials, n_threads);
 }
 
-double adjusted_rand_index(const int* clusters_A, const int* clusters_B, int num_points) {
-    if (clusters_A == NULL || clusters_B == NULL || num_points == 0) {
-        return 0.0;
+void kmeans_model_assign(const KMeansModel* model, DataSet* batch, int n_threads){
+    kmeans_model_step((KMeansModel*)model, batch, n_threads, false, NULL);
+}
+
+void kmeans_model_update(KMeansModel* model, DataSet* batch, int n_threads){
+    kmeans_model_step(model, batch, n_threads, true, NULL);
+}
+
+KMeansModel* mini_batch_k_means(const char* filename, const MiniBatchOptions* options){
+    DataReader* reader = open_data_reader(filename);
+    if(!reader) return NULL;
+    STATS_TIMER_BEGIN(mini_batch_start);
+
+    DataSet* batch = create_dataset(options->batch_size, data_reader_dims(reader));
+    if(!batch){
+        close_data_reader(reader);
+        return NULL;
     }
 
-    int max_A = 0, max_B = 0;
-    for (int i = 0; i < num_points; i++) {
-        if (clusters_A[i] > max_A) max_A = clusters_A[i];
-        if (clusters_B[i] > max_B) max_B = clusters_B[i];
+    KMeansModel* model = NULL;
+    if(read_data_batch(reader, batch)) model = kmeans_model_from_batch(batch, options->k, options->n_threads, options->seed);
+    else fprintf(stderr, "Nenhum ponto de dado carregado de %s.\n", filename);
+
+    // Buffers por thread alocados uma vez para o treino todo, nao a cada lote
+    int n_threads = options->n_threads > 0 ? options->n_threads : available_threads();
+    if(n_threads > options->batch_size) n_threads = options->batch_size;
+    KMeansPartial* partials = model ? create_partials(n_threads, model->k, model->dims) : NULL;
+
+    // O lote que semeou o modelo tambem e o primeiro do treino
+    for(int iteration = 0; model && iteration < options->iteration_limit; iteration++){
+        if(iteration > 0 && !read_data_batch(reader, batch)){
+            // Fim do arquivo: recomeca do inicio; num pipe, o treino acaba com os dados
+            if(!rewind_data_reader(reader) || !read_data_batch(reader, batch)) break;
+        }
+        kmeans_model_step(model, batch, n_threads, true, partials);
     }
-    int k_A = max_A + 1;
-    int k_B = max_B + 1;
+    if(partials) free_partials(partials, n_threads);
+
+    free_dataset(batch);
+    close_data_reader(reader);
+    STATS_TIMER_END(TIMER_MINI_BATCH, mini_batch_start);
+    return model;
+}
+
+Dendrogram* create_dendrogram(int n_points) {
+    Dendrogram* dendrogram = malloc(sizeof(Dendrogram));
+    dendrogram->n_points = n_points;
+    dendrogram->count = 0;
+    dendrogram->merges = malloc(sizeof(Merge) * (n_points > 1 ? n_points - 1 : 1));
+    return dendrogram;
+}
 
-    int** contingency_table = (int**)malloc(k_A * sizeof(int*));
-    for (int i = 0; i < k_A; i++) {
-        contingency_table[i] = (int*)calloc(k_B, sizeof(int));
+void free_dendrogram(Dendrogram* dendrogram) {
+    if (!dendrogram) return;
+    free(dendrogram->merges);
+    free(dendrogram);
+}
+
+// Merge sort estavel por altura: juncoes de mesma altura mantem a ordem em que foram feitas,
+// entao um cluster nunca aparece antes das juncoes que o formaram.
+static void sort_merges_by_height(Merge* merges, int count) {
+    Merge* buffer = malloc(sizeof(Merge) * (count > 0 ? count : 1));
+    Merge* from = merges;
+    Merge* to = buffer;
+
+    for (int width = 1; width < count; width <<= 1) {
+        for (int left = 0; left < count; left += width << 1) {
+            int middle = left + width < count ? left + width : count;
+            int right = left + (width << 1) < count ? left + (width << 1) : count;
+            int i = left, j = middle, out = left;
+            while (i < middle && j < right) to[out++] = from[j].height < from[i].height ? from[j++] : from[i++];
+            while (i < middle) to[out++] = from[i++];
+            while (j < right) to[out++] = from[j++];
+        }
+        Merge* aux = from;
+        from = to;
+        to = aux;
     }
 
-    for (int i = 0; i < num_points; i++) {
-        contingency_table[clusters_A[i]][clusters_B[i]]++;
+    if (from != merges) memcpy(merges, from, sizeof(Merge) * count);
+    free(buffer);
+}
+
+// Matriz de distancias condensada: so o triangulo superior (i < j), numa alocacao contigua.
+// Compilar com -DCONDENSED_FLOAT guarda em float e usa metade da memoria.
+#ifdef CONDENSED_FLOAT
+typedef float condensed_t;
+#else
+typedef double condensed_t;
+#endif
+
+static size_t condensed_index(int n, int i, int j) {
+    if (i > j) {
+        int aux = i;
+        i = j;
+        j = aux;
+    }
+    return (size_t)i * (2 * (size_t)n - i - 1) / 2 + (j - i - 1);
+}
+
+static condensed_t* condensed_distance_matrix(DataSet* dataset, bool euclidean) {
+    int n = dataset->count;
+    condensed_t* distances = malloc(sizeof(condensed_t) * ((size_t)n * (n - 1) / 2));
+    if (!distances) {
+        perror("Falha ao alocar a matriz de distancias");
+        return NULL;
     }
 
-    long long sum_nij_choose_2 = 0;
-    for (int i = 0; i < k_A; i++) {
-        for (int j = 0; j < k_B; j++) {
-            sum_nij_choose_2 += combinations(contingency_table[i][j], 2);
+    // Cada linha do triangulo e um bloco contiguo de pontos: uma chamada do kernel por linha
+    double* row = malloc(sizeof(double) * n);
+    double* point = malloc(sizeof(double) * dataset->dims);
+    size_t index = 0;
+    for (int i = 0; i < n - 1; i++) {
+        int m = n - i - 1;
+        gather_point(dataset, i, point);
+        squared_distances_to_block(point, (const double* const*)dataset->columns, dataset->dims, i + 1, m, row);
+        for (int j = 0; j < m; j++) distances[index++] = euclidean ? sqrt(row[j]) : row[j];
+    }
+    free(row);
+    free(point);
+    STATS_ADD(STAT_DISTANCES, (long long)index);
+    STATS_ALLOC(sizeof(condensed_t) * index);
+    return distances;
+}
+
+// Average e weighted trabalham com a distancia euclidiana; Ward, centroid e median so fazem
+// sentido geometrico com a euclidiana ao quadrado. Single e complete nao mudam com a escala.
+static bool linkage_uses_euclidean(Linkage linkage) {
+    return linkage == LINKAGE_AVERAGE || linkage == LINKAGE_WEIGHTED;
+}
+
+// Centroid e median podem ter inversoes (juncao mais baixa que a anterior), entao a
+// NN-chain nao vale pra eles.
+static bool linkage_is_reducible(Linkage linkage) {
+    return linkage != LINKAGE_CENTROID && linkage != LINKAGE_MEDIAN;
+}
+
+// Formula de Lance-Williams: distancia de other ate o cluster novo (cluster1 U cluster2)
+// a partir das distancias antigas e dos tamanhos.
+static double lance_williams(Linkage linkage, double d1, double d2, double d12, int size1, int size2, int size_other) {
+    double n12 = size1 + size2;
+    switch (linkage) {
+        case LINKAGE_SINGLE:
+            return d1 < d2 ? d1 : d2;
+        case LINKAGE_COMPLETE:
+            return d1 > d2 ? d1 : d2;
+        case LINKAGE_AVERAGE:
+            return (size1 * d1 + size2 * d2) / n12;
+        case LINKAGE_WEIGHTED:
+            return 0.5 * (d1 + d2);
+        case LINKAGE_WARD: {
+            double total = n12 + size_other;
+            return ((size1 + size_other) * d1 + (size2 + size_other) * d2 - size_other * d12) / total;
         }
+        case LINKAGE_CENTROID:
+            return (size1 * d1 + size2 * d2) / n12 - (size1 * size2 * d12) / (n12 * n12);
+        case LINKAGE_MEDIAN:
+            return 0.5 * (d1 + d2) - 0.25 * d12;
+    }
+    return d1;
+}
+
+// Union-find com compressao de caminho (halving)
+static int find_root(int* parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void join_roots(int* parent, int* size, int root1, int root2) {
+    if (size[root1] < size[root2]) {
+        int aux = root1;
+        root1 = root2;
+        root2 = aux;
     }
+    parent[root2] = root1;
+    size[root1] += size[root2];
+}
 
-    long long sum_a_choose_2 = 0;
-    for (int i = 0; i < k_A; i++) {
-        int a_i = 0;
-        for (int j = 0; j < k_B; j++) {
-            a_i += contingency_table[i][j];
+// Estado compartilhado pelas estrategias de escolha de juncao. O cluster que sobrevive a
+// uma juncao fica no indice do seu ponto, entao o indice de um cluster ativo sempre e um
+// ponto dele; os ativos ficam num vetor compacto (remocao O(1) trocando com o ultimo).
+typedef struct {
+    Linkage linkage;
+    int n;
+    condensed_t* distances;
+    int* size;
+    int* active;
+    int* active_position;
+    int quant_active;
+    Dendrogram* dendrogram;
+    // Acompanhamento: floresta das juncoes feitas (parent) e rotulos parciais
+    const ClusteringProgress* progress;
+    int progress_every;
+    int* parent;
+    int* labels;
+    int* label_of_root;
+    bool stopped;
+} HacState;
+
+static condensed_t hac_distance(const HacState* state, int i, int j) {
+    return state->distances[condensed_index(state->n, i, j)];
+}
+
+// Rotulos das juncoes feitas ate aqui: clusters com dois ou mais pontos em ordem de
+// aparicao, pontos sozinhos com -1
+static void hac_report_progress(HacState* state) {
+    for (int i = 0; i < state->n; i++) state->label_of_root[i] = -1;
+    for (int i = 0, next_id = 0; i < state->n; i++) {
+        int root = find_root(state->parent, i);
+        if (state->size[root] < 2) {
+            state->labels[i] = -1;
+            continue;
         }
-        sum_a_choose_2 += combinations(a_i, 2);
+        if (state->label_of_root[root] == -1) state->label_of_root[root] = next_id++;
+        state->labels[i] = state->label_of_root[root];
+    }
+    if (!state->progress->callback(state->progress->data, state->labels, state->n, state->dendrogram->count))
+        state->stopped = true;
+}
+
+// Junta cluster2 em cluster1 (cluster1 < cluster2), atualiza a matriz e registra a juncao
+static void hac_merge(HacState* state, int cluster1, int cluster2, condensed_t merge_distance) {
+    int removed_position = state->active_position[cluster2];
+    state->active[removed_position] = state->active[--state->quant_active];
+    state->active_position[state->active[removed_position]] = removed_position;
+
+    for (int i = 0; i < state->quant_active; i++) {
+        int other = state->active[i];
+        if (other == cluster1) continue;
+        size_t index1 = condensed_index(state->n, cluster1, other);
+        state->distances[index1] = lance_williams(state->linkage, state->distances[index1],
+                                                  hac_distance(state, cluster2, other), merge_distance,
+                                                  state->size[cluster1], state->size[cluster2], state->size[other]);
     }
+    state->size[cluster1] += state->size[cluster2];
+    STATS_ADD(STAT_MERGES, 1);
+    STATS_ADD(STAT_MATRIX_UPDATES, state->quant_active - 1);
+
+    Merge* merge = &state->dendrogram->merges[state->dendrogram->count++];
+    merge->point1 = cluster1;
+    merge->point2 = cluster2;
+    merge->height = merge_distance;
+
+    if (state->progress) {
+        // O indice de um cluster ativo e a raiz dele na floresta
+        state->parent[cluster2] = cluster1;
+        if (state->dendrogram->count % state->progress_every == 0) hac_report_progress(state);
+    }
+}
+
+// Cadeia de vizinhos mais proximos (NN-chain): O(n^2) tempo para ligacoes redutiveis.
+static void hac_nn_chain(HacState* state) {
+    int* chain = malloc(sizeof(int) * state->n);
+    int chain_length = 0;
+
+    while (state->quant_active > 1 && !state->stopped) {
+        if (chain_length == 0) chain[chain_length++] = state->active[0];
 
-    long long sum_b_choose_2 = 0;
-    for (int j = 0; j < k_B; j++) {
-        int b_j = 0;
-        for (int i = 0; i < k_A; i++) {
-            b_j += contingency_table[i][j];
+        int cluster1, cluster2;
+        condensed_t merge_distance;
+
+        // Cresce a cadeia ate achar um par de vizinhos mais proximos reciprocos
+        while (1) {
+            cluster1 = chain[chain_length - 1];
+            int previous = chain_length >= 2 ? chain[chain_length - 2] : -1;
+
+            // Empate favorece o anterior da cadeia, senao ela pode ciclar
+            int nearest = previous;
+            condensed_t nearest_distance = previous != -1 ? hac_distance(state, cluster1, previous) : 0;
+            for (int i = 0; i < state->quant_active; i++) {
+                int candidate = state->active[i];
+                if (candidate == cluster1) continue;
+                condensed_t distance = hac_distance(state, cluster1, candidate);
+                if (nearest == -1 || distance < nearest_distance) {
+                    nearest_distance = distance;
+                    nearest = candidate;
+                }
+            }
+
+            if (nearest == previous) {
+                cluster2 = previous;
+                merge_distance = nearest_distance;
+                break;
+            }
+            chain[chain_length++] = nearest;
         }
-        sum_b_choose_2 += combinations(b_j, 2);
+        chain_length -= 2;
+
+        if (cluster2 < cluster1) {
+            int aux = cluster1;
+            cluster1 = cluster2;
+            cluster2 = aux;
+        }
+        hac_merge(state, cluster1, cluster2, merge_distance);
     }
-    
-    for (int i = 0; i < k_A; i++) {
-        free(contingency_table[i]);
+
+    free(chain);
+
+    // A cadeia nao junta em ordem de altura; o corte precisa delas ordenadas
+    sort_merges_by_height(state->dendrogram->merges, state->dendrogram->count);
+}
+
+// Vizinho mais proximo de i entre os ativos de indice maior (-1 se nao houver)
+static int hac_scan_neighbor(const HacState* state, int i, condensed_t* nearest_distance) {
+    int nearest = -1;
+    for (int a = 0; a < state->quant_active; a++) {
+        int j = state->active[a];
+        if (j <= i) continue;
+        condensed_t distance = hac_distance(state, i, j);
+        if (nearest == -1 || distance < *nearest_distance) {
+            *nearest_distance = distance;
+            nearest = j;
+        }
+    }
+    return nearest;
+}
+
+// Lista de vizinhos mais proximos por linha (Anderberg): vale para qualquer ligacao, inclusive
+// com inversoes. Cada passo acha o minimo em O(n) e so reescaneia as linhas cujo vizinho sumiu
+// ou se afastou; O(n^2) no caso tipico.
+static void hac_nearest_neighbor_list(HacState* state) {
+    int n = state->n;
+    int* neighbor = malloc(sizeof(int) * n);
+    condensed_t* neighbor_distance = malloc(sizeof(condensed_t) * n);
+
+    for (int i = 0; i < n; i++) neighbor[i] = hac_scan_neighbor(state, i, &neighbor_distance[i]);
+
+    while (state->quant_active > 1 && !state->stopped) {
+        int cluster1 = -1;
+        for (int a = 0; a < state->quant_active; a++) {
+            int i = state->active[a];
+            if (neighbor[i] == -1) continue;
+            if (cluster1 == -1 || neighbor_distance[i] < neighbor_distance[cluster1] ||
+                (neighbor_distance[i] == neighbor_distance[cluster1] && i < cluster1))
+                cluster1 = i;
+        }
+        int cluster2 = neighbor[cluster1];
+        hac_merge(state, cluster1, cluster2, neighbor_distance[cluster1]);
+
+        neighbor[cluster1] = hac_scan_neighbor(state, cluster1, &neighbor_distance[cluster1]);
+        for (int a = 0; a < state->quant_active; a++) {
+            int i = state->active[a];
+            if (i >= cluster2 || i == cluster1) continue;
+            if (neighbor[i] == cluster1 || neighbor[i] == cluster2) {
+                neighbor[i] = hac_scan_neighbor(state, i, &neighbor_distance[i]);
+            } else if (i < cluster1 && hac_distance(state, i, cluster1) < neighbor_distance[i]) {
+                neighbor[i] = cluster1;
+                neighbor_distance[i] = hac_distance(state, i, cluster1);
+            }
+        }
+    }
+
+    free(neighbor);
+    free(neighbor_distance);
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Motor aglomerativo generico: matriz condensada + atualizacao de Lance-Williams.
+// Single-link vai pela arvore geradora minima, que nem precisa da matriz.
+// As alturas ficam na metrica da ligacao (ao quadrado, exceto average e weighted).
+static Dendrogram* hac_build(DataSet* dataset, Linkage linkage, HacTimings* timings, const ClusteringProgress* progress) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (timings) timings->matrix_seconds = timings->merge_seconds = 0;
+
+    if (linkage == LINKAGE_SINGLE) {
+        Dendrogram* dendrogram = single_link_dendrogram(dataset);
+        double seconds = seconds_since(&start);
+        STATS_ADD_TIME(TIMER_HAC_MERGE, seconds);
+        if (timings) timings->merge_seconds = seconds;
+        return dendrogram;
+    }
+
+    int n = dataset->count;
+    Dendrogram* dendrogram = create_dendrogram(n);
+    if (n < 2) return dendrogram;
+
+    HacState state;
+    state.linkage = linkage;
+    state.n = n;
+    state.dendrogram = dendrogram;
+    state.distances = condensed_distance_matrix(dataset, linkage_uses_euclidean(linkage));
+    if (!state.distances) {
+        free_dendrogram(dendrogram);
+        return NULL;
     }
-    free(contingency_table);
+    double matrix_seconds = seconds_since(&start);
+    STATS_ADD_TIME(TIMER_HAC_MATRIX, matrix_seconds);
+    if (timings) timings->matrix_seconds = matrix_seconds;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    // Calcula o ARI usando a fórmula
-    // ARI = (Index - ExpectedIndex) / (MaxIndex - ExpectedIndex)
-    long long total_combinations = combinations(num_points, 2);
-    double expected_index = (double)(sum_a_choose_2 * sum_b_choose_2) / total_combinations;
-    double max_index = 0.5 * (sum_a_choose_2 + sum_b_choose_2);
-    double index = sum_nij_choose_2;
+    state.size = malloc(sizeof(int) * n);
+    state.active = malloc(sizeof(int) * n);
+    state.active_position = malloc(sizeof(int) * n);
+    state.quant_active = n;
+    for (int i = 0; i < n; i++) {
+        state.size[i] = 1;
+        state.active[i] = i;
+        state.active_position[i] = i;
+    }
+
+    state.progress = progress && progress->callback ? progress : NULL;
+    state.progress_every = progress && progress->every > 0 ? progress->every : (n / 100 > 0 ? n / 100 : 1);
+    state.parent = state.labels = state.label_of_root = NULL;
+    state.stopped = false;
+    if (state.progress) {
+        state.parent = malloc(sizeof(int) * n);
+        state.labels = malloc(sizeof(int) * n);
+        state.label_of_root = malloc(sizeof(int) * n);
+        for (int i = 0; i < n; i++) state.parent[i] = i;
+    }
+
+    if (linkage_is_reducible(linkage)) hac_nn_chain(&state);
+    else hac_nearest_neighbor_list(&state);
+    double merge_seconds = seconds_since(&start);
+    STATS_ADD_TIME(TIMER_HAC_MERGE, merge_seconds);
+    if (timings) timings->merge_seconds = merge_seconds;
+
+    free(state.size);
+    free(state.active);
+    free(state.active_position);
+    free(state.parent);
+    free(state.labels);
+    free(state.label_of_root);
+    free(state.distances);
+    STATS_FREE(sizeof(condensed_t) * ((size_t)n * (n - 1) / 2));
+    if (state.stopped) {
+        free_dendrogram(dendrogram);
+        return NULL;
+    }
+    return dendrogram;
+}
+
+Dendrogram* hac_dendrogram(DataSet* dataset, Linkage linkage) {
+    return hac_build(dataset, linkage, NULL, NULL);
+}
+
+Dendrogram* hac_dendrogram_timed(DataSet* dataset, Linkage linkage, HacTimings* timings) {
+    return hac_build(dataset, linkage, timings, NULL);
+}
 
-    double numerator = index - expected_index;
-    double denominator = max_index - expected_index;
+Dendrogram* hac_dendrogram_with_progress(DataSet* dataset, Linkage linkage, const ClusteringProgress* progress) {
+    return hac_build(dataset, linkage, NULL, progress);
+}
+
+Dendrogram* complete_link_dendrogram(DataSet* dataset) {
+    return hac_dendrogram(dataset, LINKAGE_COMPLETE);
+}
+
+// Prim sobre as distancias implicitas: O(n^2) tempo e O(n) memoria, sem matriz n x n.
+// As n - 1 arestas da arvore, em ordem crescente, sao as juncoes do single-link.
+Dendrogram* single_link_dendrogram(DataSet* dataset) {
+    int quant_points = dataset->count;
+    Dendrogram* dendrogram = create_dendrogram(quant_points);
+    if (quant_points < 2) return dendrogram;
+    
+    // Pontos fora da arvore ficam compactados em colunas proprias, assim o kernel
+    // de distancias roda sobre um bloco contiguo que encolhe a cada passo.
+    int quant_remaining = quant_points - 1;
+    int dims = dataset->dims;
+    double** remaining_columns = malloc(sizeof(double*) * dims);
+    for (int d = 0; d < dims; d++) remaining_columns[d] = malloc(sizeof(double) * quant_remaining);
+    double* point = malloc(sizeof(double) * dims);
+    int* remaining_index = malloc(sizeof(int) * quant_remaining);
+    double* min_distance = malloc(sizeof(double) * quant_remaining);
+    int* closest_in_tree = malloc(sizeof(int) * quant_remaining);
+    double* distances = malloc(sizeof(double) * quant_remaining);
     
-    if (denominator == 0) {
-        return (numerator == 0) ? 1.0 : 0.0;
+    for (int r = 0; r < quant_remaining; r++) {
+        for (int d = 0; d < dims; d++) remaining_columns[d][r] = dataset->columns[d][r + 1];
+        remaining_index[r] = r + 1;
+        min_distance[r] = INFINITY;
+        closest_in_tree[r] = -1;
     }
     
-    return numerator / denominator;
+    // Comeca a arvore pelo ponto 0
+    int last_added = 0;
+    
+    while (quant_remaining > 0) {
+        int next = -1;
+        
+        // Atualiza as distancias com o ultimo ponto que entrou e acha o mais proximo da arvore
+        // (empate fica com o menor indice, como numa varredura em ordem)
+        gather_point(dataset, last_added, point);
+        squared_distances_to_block(point, (const double* const*)remaining_columns, dims, 0, quant_remaining, distances);
+        for (int r = 0; r < quant_remaining; r++) {
+            if (distances[r] < min_distance[r]) {
+                min_distance[r] = distances[r];
+                closest_in_tree[r] = last_added;
+            }
+            if (next == -1 || min_distance[r] < min_distance[next] ||
+                (min_distance[r] == min_distance[next] && remaining_index[r] < remaining_index[next]))
+                next = r;
+        }
+        
+        Merge* merge = &dendrogram->merges[dendrogram->count++];
+        merge->point1 = closest_in_tree[next];
+        merge->point2 = remaining_index[next];
+        merge->height = min_distance[next];
+        last_added = remaining_index[next];
+        
+        // Remove o ponto que entrou trocando com o ultimo
+        quant_remaining--;
+        for (int d = 0; d < dims; d++) remaining_columns[d][next] = remaining_columns[d][quant_remaining];
+        remaining_index[next] = remaining_index[quant_remaining];
+        min_distance[next] = min_distance[quant_remaining];
+        closest_in_tree[next] = closest_in_tree[quant_remaining];
+    }
+    
+    for (int d = 0; d < dims; d++) free(remaining_columns[d]);
+    free(remaining_columns);
+    free(point);
+    free(remaining_index);
+    free(min_distance);
+    free(closest_in_tree);
+    free(distances);
+    STATS_ADD(STAT_DISTANCES, (long long)quant_points * (quant_points - 1) / 2);
+    STATS_ADD(STAT_MERGES, dendrogram->count);
+    
+    sort_merges_by_height(dendrogram->merges, dendrogram->count);
+    return dendrogram;
+}
+
+// Corta o dendrograma em k clusters aplicando as n - k primeiras juncoes. Tempo quase linear.
+void cut_dendrogram(const Dendrogram* dendrogram, int k, DataSet* dataset) {
+    STATS_TIMER_BEGIN(cut_start);
+    int quant_points = dendrogram->n_points;
+    if (k < 1) k = 1;
+    if (k > quant_points) k = quant_points;
+    
+    int* parent = malloc(sizeof(int) * quant_points);
+    int* size = malloc(sizeof(int) * quant_points);
+    for (int i = 0; i < quant_points; i++) {
+        parent[i] = i;
+        size[i] = 1;
+    }
+    
+    for (int i = 0; i < quant_points - k && i < dendrogram->count; i++) {
+        int root1 = find_root(parent, dendrogram->merges[i].point1);
+        int root2 = find_root(parent, dendrogram->merges[i].point2);
+        if (root1 != root2) join_roots(parent, size, root1, root2);
+    }
+    
+    // Deixando os clusters com as corzinha tudo certo: ids em ordem de aparicao
+    int* new_cluster_id_hash = size;
+    for (int i = 0; i < quant_points; i++) new_cluster_id_hash[i] = -1;
+    
+    for (int i = 0, next_id = 0; i < quant_points; i++) {
+        int root = find_root(parent, i);
+        if (new_cluster_id_hash[root] == -1) new_cluster_id_hash[root] = next_id++;
+        dataset->cluster_id[i] = new_cluster_id_hash[root];
+    }
+    
+    free(parent);
+    free(size);
+    STATS_TIMER_END(TIMER_CUT, cut_start);
+}
+
+void single_link(DataSet* dataset, int k) {
+    Dendrogram* dendrogram = single_link_dendrogram(dataset);
+    cut_dendrogram(dendrogram, k, dataset);
+    free_dendrogram(dendrogram);
+}
+
+void complete_link(DataSet* dataset, int k) {
+    Dendrogram* dendrogram = complete_link_dendrogram(dataset);
+    cut_dendrogram(dendrogram, k, dataset);
+    free_dendrogram(dendrogram);
 }
@@ -5,14 +5,137 @@
 
 #include "data_loader.h"
 
-DataPoint* centroids(DataSet* dataset, int n_clusters);
+// Acompanhamento de uma execucao longa: callback recebe os rotulos parciais dos n pontos a
+// cada etapa (iteracao do k-medias, a cada `every` juncoes do HAC), na thread do algoritmo. Se
+// devolver false, o algoritmo para ali: o k-medias fica com os rotulos atuais e o HAC
+// devolve NULL. Nos rotulos do HAC, pontos ainda sozinhos ficam com -1.
+typedef bool (*ClusteringProgressCallback)(void* data, const int* cluster_id, int count, int step);
+
+typedef struct {
+    ClusteringProgressCallback callback; // NULL: sem acompanhamento
+    void* data;
+    int every; // HAC: juncoes entre duas chamadas (0 = n / 100)
+} ClusteringProgress;
+
+// Variantes do k-medias. Hamerly e Elkan guardam limites de distancia por ponto e pulam
+// os calculos que a desigualdade triangular garante que nao mudam nada: as atribuicoes
+// sao as mesmas do Lloyd, iteracao por iteracao.
+typedef enum {
+    KMEANS_AUTO = 0, // Hamerly para k pequeno, Elkan para k grande
+    KMEANS_LLOYD, // todas as k distancias de todos os pontos
+    KMEANS_HAMERLY, // um limite inferior por ponto
+    KMEANS_ELKAN // um limite inferior por ponto e centroide (n * k doubles)
+} KMeansAlgorithm;
+
+// Escolha dos centroides iniciais
+typedef enum {
+    KMEANS_SEED_SPREAD = 0, // pontos igualmente espacados na ordem do arquivo (sem sorteio)
+    KMEANS_SEED_PLUS_PLUS, // k-means++: k passadas sobre os dados
+    KMEANS_SEED_PARALLEL, // k-means||: poucas passadas sorteando ~2k pontos por vez
+    KMEANS_SEED_AUTO // k-means++ para n pequeno, k-means|| para n grande
+} KMeansSeeding;
+
+typedef struct {
+    int k;
+    int iteration_limit;
+    int n_threads; // 0 = todos os nucleos
+    KMeansAlgorithm algorithm;
+    KMeansSeeding seeding;
+    unsigned long long seed; // mesma semente e threads, mesmo resultado
+    int n_restarts; // execucoes independentes (sementes diferentes); fica a de menor inercia
+    ClusteringProgress progress; // com reinicios, so os da primeira thread sao acompanhados
+} KMeansOptions;
+
+KMeansOptions kmeans_default_options(int k, int iteration_limit);
+
+// Devolve a inercia (soma das distancias ao quadrado de cada ponto ao seu centroide)
+double k_means_with_options(DataSet* dataset, const KMeansOptions* options);
 
 void k_means(DataSet* dataset, int k, int iteration_limit);
 
+// k-medias em lotes (mini-batch), para dados maiores que a memoria ou que chegam aos poucos:
+// cada lote e atribuido aos centroides e cada centroide anda na direcao dos seus pontos com
+// taxa de aprendizado 1 / (pontos que ele ja absorveu).
+typedef struct {
+    int k;
+    int dims;
+    double** centroid_columns; // centroid_columns[d][c]
+    long long* counts; // pontos ja absorvidos por cada centroide
+} KMeansModel;
+
+typedef struct {
+    int k;
+    int batch_size; // pontos por lote: limita a memoria usada
+    int iteration_limit; // quantidade de lotes; no fim do arquivo volta ao inicio
+    int n_threads; // 0 = todos os nucleos
+    unsigned long long seed;
+} MiniBatchOptions;
+
+MiniBatchOptions mini_batch_default_options(int k, int batch_size, int iteration_limit);
+
+// Treina lendo o arquivo lote a lote (ver DataReader); NULL se nao houver pontos
+KMeansModel* mini_batch_k_means(const char* filename, const MiniBatchOptions* options);
+
+// Modelo novo com centroides sorteados por k-means++ entre os pontos do lote
+KMeansModel* kmeans_model_from_batch(const DataSet* batch, int k, int n_threads, unsigned long long seed);
+
+// Modo online: atribui os pontos novos (cluster_id do lote) e atualiza os centroides
+void kmeans_model_update(KMeansModel* model, DataSet* batch, int n_threads);
+
+// So atribui os pontos do lote aos centroides atuais, sem mudar o modelo
+void kmeans_model_assign(const KMeansModel* model, DataSet* batch, int n_threads);
+
+void free_kmeans_model(KMeansModel* model);
+
+// Juncao do agrupamento hierarquico: um ponto de cada cluster unido e a altura da juncao
+typedef struct {
+    int point1;
+    int point2;
+    double height;
+} Merge;
+
+// Lista de juncoes na ordem em que sao aplicadas (n - 1 para n pontos)
+typedef struct {
+    Merge* merges;
+    int count;
+    int n_points;
+} Dendrogram;
+
+// Politicas de ligacao do agrupamento hierarquico (atualizacao de Lance-Williams)
+typedef enum {
+    LINKAGE_SINGLE = 0,
+    LINKAGE_COMPLETE,
+    LINKAGE_AVERAGE,
+    LINKAGE_WEIGHTED,
+    LINKAGE_WARD,
+    LINKAGE_CENTROID,
+    LINKAGE_MEDIAN
+} Linkage;
+
+Dendrogram* hac_dendrogram(DataSet* dataset, Linkage linkage);
+
+// Tempo de cada fase do HAC, em segundos. O single-link nao monta matriz: tudo e juncao.
+typedef struct {
+    double matrix_seconds; // matriz de distancias condensada
+    double merge_seconds; // laco de juncoes
+} HacTimings;
+
+Dendrogram* hac_dendrogram_timed(DataSet* dataset, Linkage linkage, HacTimings* timings);
+
+// Com acompanhamento (ver ClusteringProgress). O single-link nao tem etapas intermediarias:
+// a arvore geradora so vira juncoes em ordem no fim.
+Dendrogram* hac_dendrogram_with_progress(DataSet* dataset, Linkage linkage, const ClusteringProgress* progress);
+
+Dendrogram* single_link_dendrogram(DataSet* dataset);
+
+Dendrogram* complete_link_dendrogram(DataSet* dataset);
+
+void cut_dendrogram(const Dendrogram* dendrogram, int k, DataSet* dataset);
+
+void free_dendrogram(Dendrogram* dendrogram);
+
 void single_link(DataSet* dataset, int k);
 
 void complete_link(DataSet* dataset, int k);
 
-double adjusted_rand_index(const int* clusters_A, const int* clusters_B, int num_points); 
-
 #endif //CLUSTERING_H
@@ -1,173 +1,675 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "data_loader.h"
+#include "parallel.h"
+#include "dataset_binary.h"
 
 #define INITIAL_DATASET_CAPACITY 100
 #define LINE_BUFFER_SIZE 256
+#define INITIAL_LABEL_LEN 16
+#define MAX_REPORTED_LINES 10
+// Abaixo disso por thread, dividir o arquivo nao compensa
+#define MIN_CHUNK_BYTES (1 << 20)
+// Janela inicial do leitor em lotes
+#define READER_BUFFER_SIZE (1 << 20)
 
-DataSet* create_dataset(int initial_capacity){
-    DataSet* ds =(DataSet*)malloc(sizeof(DataSet));
+DataSet* create_dataset(int initial_capacity, int dims){
+    DataSet* ds =(DataSet*)calloc(1, sizeof(DataSet));
     if(!ds){
         perror("Falha ao alocar DataSet");
         return 0;
     }
-    ds->points =(DataPoint*)malloc(initial_capacity * sizeof(DataPoint));
-    if(!ds->points){
+    if(initial_capacity < 1) initial_capacity = INITIAL_DATASET_CAPACITY;
+    if(dims < 1) dims = 1;
+    
+    ds->dims = dims;
+    ds->columns =(double**)calloc(dims, sizeof(double*));
+    ds->min =(double*)malloc(dims * sizeof(double));
+    ds->max =(double*)malloc(dims * sizeof(double));
+    ds->cluster_id =(int*)calloc(initial_capacity, sizeof(int));
+    ds->label_offset =(size_t*)malloc(initial_capacity * sizeof(size_t));
+    ds->label_pool_capacity = (size_t)initial_capacity * INITIAL_LABEL_LEN;
+    ds->label_pool =(char*)malloc(ds->label_pool_capacity);
+    if(!ds->columns || !ds->min || !ds->max || !ds->cluster_id || !ds->label_offset || !ds->label_pool){
         perror("Falha ao alocar DataPoints iniciais");
-        free(ds);
+        free_dataset(ds);
         return 0;
     }
+    for(int d = 0; d < dims; d++){
+        ds->columns[d] =(double*)malloc(initial_capacity * sizeof(double));
+        if(!ds->columns[d]){
+            perror("Falha ao alocar DataPoints iniciais");
+            free_dataset(ds);
+            return 0;
+        }
+        ds->min[d] = DBL_MAX;
+        ds->max[d] = -DBL_MAX;
+    }
     ds->count = 0;
     ds->capacity = initial_capacity;
-    ds->min_d1 = DBL_MAX;
-    ds->max_d1 = -DBL_MAX;
-    ds->min_d2 = DBL_MAX;
-    ds->max_d2 = -DBL_MAX;
+    ds->label_pool_size = 0;
     return ds;
 }
 
-static int add_point(DataSet* dataset, const char* label, double d1, double d2){
-    if(dataset->count >= dataset->capacity){
-        int new_capacity = dataset->capacity << 1;
-        if(new_capacity == 0) new_capacity = INITIAL_DATASET_CAPACITY; 
-        DataPoint* new_points =(DataPoint*)realloc(dataset->points, new_capacity * sizeof(DataPoint));
-        if(!new_points){
-            perror("Falha ao realocar DataPoints");
-            return 0;
+// Quantidade de coordenadas: campos do cabecalho menos o rotulo
+static int count_header_dims(const char* header, const char* end){
+    int fields = 0;
+    const char* c = header;
+    while(c < end){
+        while(c < end && (*c == '\t' || *c == ' ' || *c == '\r')) c++;
+        if(c == end) break;
+        fields++;
+        while(c < end && *c != '\t' && *c != ' ' && *c != '\r') c++;
+    }
+    return fields - 1;
+}
+
+static double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Le um numero de [c, end). Caminho rapido de Clinger: com mantissa < 2^53 e expoente
+// decimal ate 22 tanto a mantissa quanto a potencia sao exatas em double, entao uma unica
+// multiplicacao/divisao da o mesmo resultado arredondado que o strtod. Fora disso (ou em
+// nan/inf/hexa) o token vai pro strtod. Devolve o fim do numero, ou NULL se nao houver um.
+static const char* parse_double(const char* c, const char* end, double* value){
+    const char* start = c;
+    bool negative = false;
+    if(c < end && (*c == '-' || *c == '+')){
+        negative = *c == '-';
+        c++;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any_digit = false;
+    for(; c < end && *c >= '0' && *c <= '9'; c++){
+        any_digit = true;
+        if(mantissa || *c != '0') digits++;
+        if(digits <= 19) mantissa = mantissa * 10 + (*c - '0');
+        else exponent++;
+    }
+    if(c < end && *c == '.'){
+        for(c++; c < end && *c >= '0' && *c <= '9'; c++){
+            any_digit = true;
+            if(mantissa || *c != '0') digits++;
+            if(digits <= 19){
+                mantissa = mantissa * 10 + (*c - '0');
+                exponent--;
+            }
         }
-        dataset->points = new_points;
-        dataset->capacity = new_capacity;
     }
-    
-    strncpy(dataset->points[dataset->count].label, label, MAX_LABEL_LEN - 1);
-    dataset->points[dataset->count].label[MAX_LABEL_LEN - 1] = 0;
-    dataset->points[dataset->count].d1 = d1;
-    dataset->points[dataset->count].d2 = d2;
-    
-    if(d1 < dataset->min_d1) dataset->min_d1 = d1;
-    if(d1 > dataset->max_d1) dataset->max_d1 = d1;
-    if(d2 < dataset->min_d2) dataset->min_d2 = d2;
-    if(d2 > dataset->max_d2) dataset->max_d2 = d2;
-    
-    dataset->count++;
-    return 1;
+    if(!any_digit) goto slow_path;
+
+    if(c < end && (*c == 'e' || *c == 'E')){
+        const char* e = c + 1;
+        bool negative_exponent = false;
+        if(e < end && (*e == '-' || *e == '+')){
+            negative_exponent = *e == '-';
+            e++;
+        }
+        if(e < end && *e >= '0' && *e <= '9'){
+            int written = 0;
+            for(; e < end && *e >= '0' && *e <= '9'; e++)
+                if(written < 100000) written = written * 10 + (*e - '0');
+            exponent += negative_exponent ? -written : written;
+            c = e;
+        }
+    }
+
+    if(digits > 19 || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) goto slow_path;
+
+    double result = (double)mantissa;
+    if(exponent < 0) result /= powers_of_ten[-exponent];
+    else result *= powers_of_ten[exponent];
+    *value = negative ? -result : result;
+    return c;
+
+slow_path:;
+    // strtod precisa de string terminada em '\0', e o arquivo mapeado nao tem
+    char token[128];
+    size_t len = 0;
+    for(c = start; c < end && len < sizeof(token) - 1 && *c != '\t' && *c != ' ' && *c != '\r' && *c != '\n'; c++)
+        token[len++] = *c;
+    token[len] = 0;
+    char* token_end;
+    *value = strtod(token, &token_end);
+    if(token_end == token) return NULL;
+    return start + (token_end - token);
+}
+
+// Le "rotulo\tc1\tc2...\tcD" de [p, line_end) (sem espacos no inicio) no ponto i das colunas.
+// Devolve false se a linha estiver mal formatada.
+static bool parse_point(const char* p, const char* line_end, double** columns, int dims, int i, const char** label, size_t* label_len){
+    *label = p;
+    while(p < line_end && *p != '\t' && *p != ' ' && *p != '\r') p++;
+    *label_len = p - *label;
+    if(*label_len > MAX_LABEL_LEN - 1) *label_len = MAX_LABEL_LEN - 1;
+
+    for(int d = 0; d < dims; d++){
+        while(p < line_end && (*p == ' ' || *p == '\t')) p++;
+        double value;
+        const char* number_end = parse_double(p, line_end, &value);
+        if(!number_end || (number_end < line_end && *number_end != '\t' && *number_end != ' ' && *number_end != '\r'))
+            return false;
+        columns[d][i] = value;
+        p = number_end;
+    }
+    while(p < line_end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p == line_end;
+}
+
+// Bloco de linhas inteiras do arquivo, processado por uma thread
+typedef struct {
+    const char* begin;
+    const char* end;
+    int first_line; // numero no arquivo da primeira linha do bloco
+    int line_count;
+    int first_point; // onde o bloco comeca a escrever nas colunas
+    int valid; // pontos lidos
+    int malformed;
+    int reported[MAX_REPORTED_LINES];
+    char* labels; // pool de rotulos local do bloco
+    size_t labels_size;
+    double* min;
+    double* max;
+} LoadChunk;
+
+typedef struct {
+    LoadChunk* chunks;
+    DataSet* dataset;
+} LoadContext;
+
+static int count_lines(const char* begin, const char* end){
+    int lines = 0;
+    const char* c = begin;
+    while(c < end){
+        const char* newline = memchr(c, '\n', end - c);
+        lines++;
+        if(!newline) break;
+        c = newline + 1;
+    }
+    return lines;
+}
+
+static void count_lines_task(void* context, int thread_index, int begin, int end){
+    (void)thread_index;
+    LoadChunk* chunks = ((LoadContext*)context)->chunks;
+    for(int t = begin; t < end; t++) chunks[t].line_count = count_lines(chunks[t].begin, chunks[t].end);
+}
+
+// Le "rotulo\tc1\tc2...\tcD" de cada linha do bloco direto nas colunas
+static void parse_chunk_task(void* context, int thread_index, int begin, int end){
+    (void)thread_index;
+    LoadContext* ctx = (LoadContext*)context;
+    DataSet* dataset = ctx->dataset;
+    int dims = dataset->dims;
+
+    for(int t = begin; t < end; t++){
+        LoadChunk* chunk = &ctx->chunks[t];
+        for(int d = 0; d < dims; d++){
+            chunk->min[d] = DBL_MAX;
+            chunk->max[d] = -DBL_MAX;
+        }
+
+        const char* c = chunk->begin;
+        int line_num = chunk->first_line;
+        while(c < chunk->end){
+            const char* line_end = memchr(c, '\n', chunk->end - c);
+            if(!line_end) line_end = chunk->end;
+
+            const char* p = c;
+            while(p < line_end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+
+            if(p < line_end){
+                int i = chunk->first_point + chunk->valid;
+                const char* label;
+                size_t label_len;
+                bool ok = parse_point(p, line_end, dataset->columns, dims, i, &label, &label_len);
+
+                if(ok){
+                    for(int d = 0; d < dims; d++){
+                        double value = dataset->columns[d][i];
+                        if(value < chunk->min[d]) chunk->min[d] = value;
+                        if(value > chunk->max[d]) chunk->max[d] = value;
+                    }
+                    dataset->label_offset[i] = chunk->labels_size;
+                    memcpy(chunk->labels + chunk->labels_size, label, label_len);
+                    chunk->labels[chunk->labels_size + label_len] = 0;
+                    chunk->labels_size += label_len + 1;
+                    chunk->valid++;
+                } else{
+                    if(chunk->malformed < MAX_REPORTED_LINES) chunk->reported[chunk->malformed] = line_num;
+                    chunk->malformed++;
+                }
+            }
+
+            c = line_end < chunk->end ? line_end + 1 : chunk->end;
+            line_num++;
+        }
+    }
+}
+
+char* map_data_file(const char* filename, size_t* size, bool* mapped){
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return NULL;
+
+    struct stat info;
+    char* data = NULL;
+    *mapped = false;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED){
+            posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+            *size = info.st_size;
+            *mapped = true;
+            close(fd);
+            return data;
+        }
+        data = NULL;
+    }
+
+    size_t capacity = 1 << 16, used = 0;
+    data = malloc(capacity);
+    ssize_t got;
+    while(data && (got = read(fd, data + used, capacity - used)) > 0){
+        used += got;
+        if(used == capacity){
+            char* bigger = realloc(data, capacity << 1);
+            if(!bigger){
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = bigger;
+            capacity <<= 1;
+        }
+    }
+    close(fd);
+    *size = used;
+    return data;
+}
+
+void unmap_data_file(char* data, size_t size, bool mapped){
+    if(mapped) munmap(data, size);
+    else free(data);
 }
 
 DataSet* load_data_from_file(const char* filename){
-    FILE* file = fopen(filename, "r");
-    if(!file){
+    if(is_binary_dataset_file(filename)) return load_binary_dataset(filename);
+    return load_data_from_file_threads(filename, 0);
+}
+
+DataSet* load_data_from_file_threads(const char* filename, int n_threads){
+    size_t size = 0;
+    bool mapped;
+    char* data = map_data_file(filename, &size, &mapped);
+    if(!data){
         perror("Erro ao abrir arquivo de dados.");
         return 0;
     }
-    
-    DataSet* dataset = create_dataset(INITIAL_DATASET_CAPACITY);
-    if(!dataset){
-        fclose(file);
+    const char* end = data + size;
+
+    const char* header_end = memchr(data, '\n', size);
+    if(!size || !header_end){
+        fprintf(stderr, "Erro ao ler cabeçalho ou arquivo vazio: %s\n", filename);
+        unmap_data_file(data, size, mapped);
         return 0;
     }
-    
-    char line_buffer[LINE_BUFFER_SIZE];
-    char label_buffer[MAX_LABEL_LEN];
-    double d1_val, d2_val;
-    
-    if(fgets(line_buffer, sizeof(line_buffer), file) == 0){
-        fprintf(stderr, "Erro ao ler cabeçalho ou arquivo vazio: %s\n", filename);
-        free_dataset(dataset);
-        fclose(file);
+
+    int dims = count_header_dims(data, header_end);
+    if(dims < 1){
+        fprintf(stderr, "Cabeçalho sem coordenadas em %s\n", filename);
+        unmap_data_file(data, size, mapped);
         return 0;
     }
-    
-    int line_num = 1;
-    while(fgets(line_buffer, sizeof(line_buffer), file) != 0){
-        line_num++;
-        sscanf(line_buffer, "%49s\t%lf\t%lf", label_buffer, &d1_val, &d2_val);
-        if(!add_point(dataset, label_buffer, d1_val, d2_val)){
-            fprintf(stderr, "Falha ao adicionar ponto da linha %d do arquivo %s\n", line_num, filename);
-            free_dataset(dataset);
-            fclose(file);
-            return 0;
+
+    // Blocos de linhas inteiras: divide os bytes e avanca cada corte ate o proximo '\n'
+    const char* body = header_end + 1;
+    size_t body_size = end - body;
+    if(n_threads < 1) n_threads = available_threads();
+    if((size_t)n_threads > body_size / MIN_CHUNK_BYTES) n_threads = body_size / MIN_CHUNK_BYTES;
+    if(n_threads < 1) n_threads = 1;
+
+    LoadChunk* chunks = calloc(n_threads, sizeof(LoadChunk));
+    const char* cut = body;
+    for(int t = 0; t < n_threads; t++){
+        chunks[t].begin = cut;
+        if(t == n_threads - 1) cut = end;
+        else{
+            cut = body + body_size * (t + 1) / n_threads;
+            if(cut < chunks[t].begin) cut = chunks[t].begin;
+            const char* newline = memchr(cut, '\n', end - cut);
+            cut = newline ? newline + 1 : end;
         }
+        chunks[t].end = cut;
     }
-    
-    if(ferror(file)){
-        perror("Erro durante a leitura do arquivo");
+
+    LoadContext context;
+    context.chunks = chunks;
+    parallel_for(n_threads, n_threads, count_lines_task, &context);
+
+    // Ja sabe quantas linhas tem: aloca tudo de uma vez
+    int total_lines = 0;
+    for(int t = 0; t < n_threads; t++){
+        chunks[t].first_line = total_lines + 2;
+        chunks[t].first_point = total_lines;
+        total_lines += chunks[t].line_count;
+        chunks[t].labels = malloc((chunks[t].end - chunks[t].begin) + chunks[t].line_count + 1);
+        chunks[t].min = malloc(sizeof(double) * dims);
+        chunks[t].max = malloc(sizeof(double) * dims);
+    }
+
+    DataSet* dataset = create_dataset(total_lines, dims);
+    if(!dataset){
+        for(int t = 0; t < n_threads; t++){
+            free(chunks[t].labels);
+            free(chunks[t].min);
+            free(chunks[t].max);
+        }
+        free(chunks);
+        unmap_data_file(data, size, mapped);
+        return 0;
+    }
+    context.dataset = dataset;
+    parallel_for(n_threads, n_threads, parse_chunk_task, &context);
+
+    // Junta os blocos: compacta os pontos (linhas ruins deixam buracos) e os rotulos
+    size_t labels_size = 0;
+    for(int t = 0; t < n_threads; t++) labels_size += chunks[t].labels_size;
+    char* label_pool = realloc(dataset->label_pool, labels_size ? labels_size : 1);
+    if(label_pool){
+        dataset->label_pool = label_pool;
+        dataset->label_pool_capacity = labels_size ? labels_size : 1;
+    }
+
+    int count = 0, malformed = 0;
+    for(int t = 0; t < n_threads && label_pool; t++){
+        LoadChunk* chunk = &chunks[t];
+        for(int d = 0; d < dims; d++){
+            if(count != chunk->first_point)
+                memmove(dataset->columns[d] + count, dataset->columns[d] + chunk->first_point, sizeof(double) * chunk->valid);
+            if(chunk->min[d] < dataset->min[d]) dataset->min[d] = chunk->min[d];
+            if(chunk->max[d] > dataset->max[d]) dataset->max[d] = chunk->max[d];
+        }
+        for(int v = 0; v < chunk->valid; v++)
+            dataset->label_offset[count + v] = dataset->label_offset[chunk->first_point + v] + dataset->label_pool_size;
+        memcpy(dataset->label_pool + dataset->label_pool_size, chunk->labels, chunk->labels_size);
+        dataset->label_pool_size += chunk->labels_size;
+        count += chunk->valid;
+
+        for(int r = 0; r < chunk->malformed && malformed + r < MAX_REPORTED_LINES; r++)
+            fprintf(stderr, "Aviso: linha %d mal formatada em %s, ignorada.\n", chunk->reported[r], filename);
+        malformed += chunk->malformed;
+    }
+    dataset->count = count;
+
+    if(malformed > MAX_REPORTED_LINES)
+        fprintf(stderr, "Aviso: %d linhas mal formatadas em %s no total.\n", malformed, filename);
+
+    for(int t = 0; t < n_threads; t++){
+        free(chunks[t].labels);
+        free(chunks[t].min);
+        free(chunks[t].max);
+    }
+    free(chunks);
+    unmap_data_file(data, size, mapped);
+
+    if(!label_pool){
+        perror("Falha ao alocar os rótulos");
         free_dataset(dataset);
-        fclose(file);
         return 0;
     }
-    
-    fclose(file);
-    
+
     if(!dataset->count) fprintf(stderr, "Nenhum ponto de dado carregado de %s.\n", filename);
-    
+
     return dataset;
 }
 
-void free_dataset(DataSet* dataset){
-    if(!dataset) return;
-    if(dataset->points) free(dataset->points);
-    free(dataset);
+// Leitor em lotes. Texto: janela de bytes que anda pelo arquivo (ou pipe) sem nunca ter
+// ele inteiro na memoria. Binario: o arquivo mapeado, copiado lote a lote.
+struct DataReader {
+    char* filename;
+    int dims;
+    int fd; // -1 no binario
+    char* buffer; // bytes lidos e ainda nao consumidos ficam em [start, used)
+    size_t capacity;
+    size_t start;
+    size_t used;
+    bool eof;
+    off_t body_offset; // onde comecam os pontos, para voltar ao inicio
+    int line_num;
+    int malformed;
+    DataSet* binary;
+    int position; // proximo ponto do binario
+};
+
+// Traz mais bytes do arquivo; dobra a janela se uma linha nao couber nela
+static bool reader_fill(DataReader* reader){
+    if(reader->eof) return false;
+    if(reader->start > 0){
+        memmove(reader->buffer, reader->buffer + reader->start, reader->used - reader->start);
+        reader->used -= reader->start;
+        reader->start = 0;
+    }
+    if(reader->used == reader->capacity){
+        char* bigger = realloc(reader->buffer, reader->capacity << 1);
+        if(!bigger){
+            perror("Falha ao alocar o buffer de leitura");
+            reader->eof = true;
+            return false;
+        }
+        reader->buffer = bigger;
+        reader->capacity <<= 1;
+    }
+
+    ssize_t got = read(reader->fd, reader->buffer + reader->used, reader->capacity - reader->used);
+    if(got <= 0){
+        reader->eof = true;
+        return false;
+    }
+    reader->used += got;
+    return true;
 }
 
-int* load_clusters(const char* filename, int num_points) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        printf("Aviso: Não foi possível abrir o arquivo de clusters de referência '%s'.\n", filename);
-        return NULL;
+// Proxima linha inteira em [*line, *line_end); a ultima pode nao ter '\n'
+static bool reader_next_line(DataReader* reader, const char** line, const char** line_end){
+    for(;;){
+        const char* begin = reader->buffer + reader->start;
+        const char* newline = memchr(begin, '\n', reader->used - reader->start);
+        if(newline){
+            *line = begin;
+            *line_end = newline;
+            reader->start = newline + 1 - reader->buffer;
+            return true;
+        }
+        if(!reader_fill(reader)){
+            if(reader->start == reader->used) return false;
+            *line = reader->buffer + reader->start;
+            *line_end = reader->buffer + reader->used;
+            reader->start = reader->used;
+            return true;
+        }
     }
-    
-    int* clusters = (int*)malloc(sizeof(int) * num_points);
-    if (!clusters) {
-        perror("Falha ao alocar memória para os clusters de referência");
-        fclose(file);
-        return NULL;
+}
+
+DataReader* open_data_reader(const char* filename){
+    DataReader* reader = calloc(1, sizeof(DataReader));
+    if(!reader){
+        perror("Falha ao alocar o leitor");
+        return 0;
     }
-    
-    char line_buffer[LINE_BUFFER_SIZE];
-    int point_index = 0;
-    int cluster_id;
-    
-    while (fgets(line_buffer, sizeof(line_buffer), file) != NULL && point_index < num_points) {
-        if (sscanf(line_buffer, "%*s\t%d", &cluster_id) == 1) {
-            clusters[point_index] = cluster_id;
-        } else {
-            fprintf(stderr, "Aviso: Linha mal formatada no arquivo de referência: %s", line_buffer);
-            clusters[point_index] = 0;
+    reader->filename = strdup(filename);
+    reader->fd = -1;
+
+    if(is_binary_dataset_file(filename)){
+        reader->binary = load_binary_dataset(filename);
+        if(!reader->binary){
+            close_data_reader(reader);
+            return 0;
         }
-        point_index++;
+        reader->dims = reader->binary->dims;
+        return reader;
     }
-    
-    if (point_index < num_points) {
-        fprintf(stderr, "Aviso: O arquivo de referência '%s' contém menos pontos (%d) do que o dataset (%d).\n", filename, point_index, num_points);
+
+    reader->fd = strcmp(filename, "-") ? open(filename, O_RDONLY) : STDIN_FILENO;
+    reader->capacity = READER_BUFFER_SIZE;
+    reader->buffer = malloc(reader->capacity);
+    if(reader->fd < 0 || !reader->buffer){
+        perror("Erro ao abrir arquivo de dados.");
+        close_data_reader(reader);
+        return 0;
     }
-    
-    fclose(file);
-    return clusters;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    const char* header;
+    const char* header_end;
+    if(!reader_next_line(reader, &header, &header_end)){
+        fprintf(stderr, "Erro ao ler cabeçalho ou arquivo vazio: %s\n", filename);
+        close_data_reader(reader);
+        return 0;
+    }
+    reader->dims = count_header_dims(header, header_end);
+    if(reader->dims < 1){
+        fprintf(stderr, "Cabeçalho sem coordenadas em %s\n", filename);
+        close_data_reader(reader);
+        return 0;
+    }
+    reader->body_offset = header_end + 1 - reader->buffer;
+    reader->line_num = 2;
+    return reader;
+}
+
+int data_reader_dims(const DataReader* reader){
+    return reader->dims;
+}
+
+static void append_label(DataSet* batch, const char* label, size_t label_len){
+    if(batch->label_pool_size + label_len + 1 > batch->label_pool_capacity){
+        size_t capacity = batch->label_pool_capacity << 1;
+        if(capacity < batch->label_pool_size + label_len + 1) capacity = batch->label_pool_size + label_len + 1;
+        char* bigger = realloc(batch->label_pool, capacity);
+        if(!bigger){
+            // Sem memoria para o rotulo: o ponto fica com rotulo vazio
+            batch->label_offset[batch->count] = batch->label_pool_size ? batch->label_pool_size - 1 : 0;
+            return;
+        }
+        batch->label_pool = bigger;
+        batch->label_pool_capacity = capacity;
+    }
+    batch->label_offset[batch->count] = batch->label_pool_size;
+    memcpy(batch->label_pool + batch->label_pool_size, label, label_len);
+    batch->label_pool[batch->label_pool_size + label_len] = 0;
+    batch->label_pool_size += label_len + 1;
 }
 
-void free_clusters(int* clusters) {
-    if (clusters) {
-        free(clusters);
+static int read_binary_batch(DataReader* reader, DataSet* batch){
+    const DataSet* binary = reader->binary;
+    int m = binary->count - reader->position;
+    if(m > batch->capacity) m = batch->capacity;
+
+    for(int d = 0; d < batch->dims; d++)
+        memcpy(batch->columns[d], binary->columns[d] + reader->position, sizeof(double) * m);
+    for(int j = 0; j < m; j++){
+        const char* label = dataset_label(binary, reader->position + j);
+        append_label(batch, label, strlen(label));
+        batch->count++;
     }
+    reader->position += m;
+    return m;
 }
 
-void write_clu(DataSet* dataset, char* filename, int k, int chosen_algorithm){
-    // Criando o arquivo:
-    char file_path[1 << 8];
-    sprintf(file_path, "../data/resultados/G1_%s_%d_%d.clu", filename, chosen_algorithm, k);
-    
-    FILE* file = fopen(file_path, "w");
-    
-    // Escrevendo no arquivo:
-    char line[1 << 8] = {'\0'};
-    for (int i = 0; i < dataset->count; i++) {
-    	snprintf(line, sizeof(line), "%s\t%d", dataset->points[i].label, dataset->points[i].cluster_id);
-    	fwrite(line, sizeof(char), strlen(line), file);
-    	if (i != dataset->count-1) fprintf(file, "\n");
-    }
-    fclose(file);
-    
-    return;
+int read_data_batch(DataReader* reader, DataSet* batch){
+    batch->count = 0;
+    batch->label_pool_size = 0;
+    if(batch->dims != reader->dims) return 0;
+
+    const char* line;
+    const char* line_end;
+    if(reader->binary) read_binary_batch(reader, batch);
+    else while(batch->count < batch->capacity && reader_next_line(reader, &line, &line_end)){
+        const char* p = line;
+        while(p < line_end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+
+        if(p < line_end){
+            const char* label;
+            size_t label_len;
+            if(parse_point(p, line_end, batch->columns, batch->dims, batch->count, &label, &label_len)){
+                append_label(batch, label, label_len);
+                batch->count++;
+            } else{
+                if(reader->malformed < MAX_REPORTED_LINES)
+                    fprintf(stderr, "Aviso: linha %d mal formatada em %s, ignorada.\n", reader->line_num, reader->filename);
+                reader->malformed++;
+            }
+        }
+        reader->line_num++;
+    }
+
+    for(int d = 0; d < batch->dims; d++){
+        batch->min[d] = DBL_MAX;
+        batch->max[d] = -DBL_MAX;
+        for(int i = 0; i < batch->count; i++){
+            double value = batch->columns[d][i];
+            if(value < batch->min[d]) batch->min[d] = value;
+            if(value > batch->max[d]) batch->max[d] = value;
+        }
+    }
+    return batch->count;
+}
+
+int rewind_data_reader(DataReader* reader){
+    if(reader->binary){
+        reader->position = 0;
+        return 1;
+    }
+    if(lseek(reader->fd, reader->body_offset, SEEK_SET) != reader->body_offset) return 0;
+    reader->start = reader->used = 0;
+    reader->eof = false;
+    reader->line_num = 2;
+    return 1;
+}
+
+void close_data_reader(DataReader* reader){
+    if(!reader) return;
+    if(reader->malformed > MAX_REPORTED_LINES)
+        fprintf(stderr, "Aviso: %d linhas mal formatadas em %s no total.\n", reader->malformed, reader->filename);
+    if(reader->fd > STDIN_FILENO) close(reader->fd);
+    free(reader->buffer);
+    free_dataset(reader->binary);
+    free(reader->filename);
+    free(reader);
+}
+
+void free_dataset(DataSet* dataset){
+    if(!dataset) return;
+    if(dataset->mapping){
+        // Colunas e rotulos sao do mapeamento
+        munmap(dataset->mapping, dataset->mapping_size);
+    } else {
+        if(dataset->columns){
+            for(int d = 0; d < dataset->dims; d++) free(dataset->columns[d]);
+        }
+        free(dataset->label_offset);
+        free(dataset->label_pool);
+    }
+    free(dataset->columns);
+    free(dataset->min);
+    free(dataset->max);
+    free(dataset->cluster_id);
+    free(dataset);
+}
+
+const char* dataset_label(const DataSet* dataset, int i){
+    return dataset->label_pool + dataset->label_offset[i];
 }
@@ -2,38 +2,68 @@
 #ifndef DATA_LOADER_H
 #define DATA_LOADER_H
 
+#include <stddef.h>
+
 #define MAX_LABEL_LEN 50
 
 // MUDANCAS LORENZO:
 typedef enum { false = 0, true = 1 } bool;
 
+// Pontos em estrutura de vetores: cada coordenada numa coluna contigua, os clusters num
+// vetor proprio e os rotulos num pool de strings separado, fora dos lacos quentes.
+// A quantidade de coordenadas vem do cabecalho do arquivo.
 typedef struct {
-    char label[MAX_LABEL_LEN];
-    double d1;
-    double d2;
-    int cluster_id;
-} DataPoint;
-
-typedef struct {
-    DataPoint *points;
+    int dims; // qtd de coordenadas de cada ponto
+    double **columns; // columns[d][i]: coordenada d do ponto i
+    double *min; // limites de cada coordenada
+    double *max;
+    int *cluster_id;
+    char *label_pool; // rotulos concatenados, cada um terminado em '\0'
+    size_t *label_offset; // inicio do rotulo de cada ponto no pool
+    size_t label_pool_size;
+    size_t label_pool_capacity;
     int count; // qtd de pontos no vetor
     int capacity; // capacidade de pontos max do vetor
-    double min_d1, max_d1;
-    double min_d2, max_d2;
+    void *mapping; // arquivo binario mapeado (colunas e rotulos apontam pra ele), ou NULL
+    size_t mapping_size;
 } DataSet;
 
-DataSet* create_dataset(int initial_capacity);
+DataSet* create_dataset(int initial_capacity, int dims);
 
+// Mapeia o arquivo e le as linhas em blocos paralelos (n_threads = 0 usa todos os nucleos).
+// Linhas mal formatadas sao avisadas no stderr e ignoradas.
+DataSet* load_data_from_file_threads(const char* filename, int n_threads);
+
+// Arquivos .ccb (ver dataset_binary.h) sao mapeados direto, sem parsing
 DataSet* load_data_from_file(const char* filename);
 
+// Leitura em lotes, sem carregar o arquivo inteiro: a memoria fica limitada ao lote.
+// Aceita .txt (tambem de um pipe; "-" le a entrada padrao) e .ccb.
+typedef struct DataReader DataReader;
+
+DataReader* open_data_reader(const char* filename);
+
+int data_reader_dims(const DataReader* reader);
+
+// Troca o conteudo de batch (criado com create_dataset(tamanho_do_lote, dims)) pelos
+// proximos batch->capacity pontos. Devolve quantos leu; 0 no fim do arquivo.
+int read_data_batch(DataReader* reader, DataSet* batch);
+
+// Volta ao primeiro ponto. Devolve 0 se a entrada nao permitir (pipe).
+int rewind_data_reader(DataReader* reader);
+
+void close_data_reader(DataReader* reader);
+
 void free_dataset(DataSet* dataset);
 
-void print_dataset_summary(const DataSet* dataset);
+// Mapeia o arquivo inteiro; se nao der (pipe, por exemplo), le tudo pra memoria.
+// mapped diz qual dos dois aconteceu, para o unmap_data_file.
+char* map_data_file(const char* filename, size_t* size, bool* mapped);
 
-void write_clu(DataSet* dataset, char* dataset_name, int k, int chosen_algorithm);
+void unmap_data_file(char* data, size_t size, bool mapped);
 
-int* load_clusters(const char* filename, int num_points);
+const char* dataset_label(const DataSet* dataset, int i);
 
-void free_clusters(int* clusters);
+void print_dataset_summary(const DataSet* dataset);
 
 #endif // DATA_LOADER_H
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dataset_binary.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+static unsigned long long align_up(unsigned long long offset){
+    return (offset + BINARY_DATASET_ALIGNMENT - 1) / BINARY_DATASET_ALIGNMENT * BINARY_DATASET_ALIGNMENT;
+}
+
+static unsigned long long bounds_offset(void){
+    return sizeof(BinaryDatasetHeader);
+}
+
+static unsigned long long column_stride(const BinaryDatasetHeader* header){
+    return align_up(header->count * sizeof(double));
+}
+
+// Posicao da coluna d no arquivo
+static unsigned long long column_offset(const BinaryDatasetHeader* header, unsigned long long d){
+    return header->columns_offset + d * column_stride(header);
+}
+
+// [offset, offset + length) cabe nos size bytes do arquivo; subtrai em vez de somar, que
+// com valores de um arquivo adulterado poderia dar a volta
+static int fits_in_file(unsigned long long offset, unsigned long long length, unsigned long long size){
+    return offset <= size && length <= size - offset;
+}
+
+static int write_padding(FILE* file, unsigned long long target){
+    static const char zeros[BINARY_DATASET_ALIGNMENT] = {0};
+    long position = ftell(file);
+    if(position < 0) return 0;
+    unsigned long long missing = target - (unsigned long long)position;
+    return fwrite(zeros, 1, missing, file) == missing;
+}
+
+int is_binary_dataset_file(const char* filename){
+    size_t len = strlen(filename), extension_len = strlen(BINARY_DATASET_EXTENSION);
+    return len >= extension_len && !strcmp(filename + len - extension_len, BINARY_DATASET_EXTENSION);
+}
+
+int write_binary_dataset(const DataSet* dataset, const char* filename){
+    FILE* file = fopen(filename, "wb");
+    if(!file){
+        perror("Erro ao criar o arquivo binário");
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+    BinaryDatasetHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_DATASET_MAGIC, sizeof(BINARY_DATASET_MAGIC));
+    header.version = BINARY_DATASET_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.dims = dataset->dims;
+    header.count = dataset->count;
+    header.columns_offset = align_up(bounds_offset() + 2 * sizeof(double) * dataset->dims);
+    header.label_offsets_offset = column_offset(&header, dataset->dims);
+    header.label_pool_offset = header.label_offsets_offset + header.count * sizeof(unsigned long long);
+    header.label_pool_size = dataset->label_pool_size;
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(dataset->min, sizeof(double), dataset->dims, file) == (size_t)dataset->dims;
+    ok = ok && fwrite(dataset->max, sizeof(double), dataset->dims, file) == (size_t)dataset->dims;
+
+    for(int d = 0; d < dataset->dims && ok; d++){
+        ok = write_padding(file, column_offset(&header, d));
+        ok = ok && fwrite(dataset->columns[d], sizeof(double), dataset->count, file) == (size_t)dataset->count;
+    }
+    ok = ok && write_padding(file, header.label_offsets_offset);
+
+    for(int i = 0; i < dataset->count && ok; i++){
+        unsigned long long offset = dataset->label_offset[i];
+        ok = fwrite(&offset, sizeof(offset), 1, file) == 1;
+    }
+    ok = ok && fwrite(dataset->label_pool, 1, dataset->label_pool_size, file) == dataset->label_pool_size;
+
+    if(fclose(file) != 0) ok = 0;
+    if(!ok){
+        perror("Erro ao escrever o arquivo binário");
+        remove(filename);
+    }
+    return ok;
+}
+
+DataSet* load_binary_dataset(const char* filename){
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        perror("Erro ao abrir arquivo de dados.");
+        return 0;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(BinaryDatasetHeader)){
+        fprintf(stderr, "Arquivo binário inválido: %s\n", filename);
+        close(fd);
+        return 0;
+    }
+
+    size_t size = info.st_size;
+    char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        perror("Erro ao mapear o arquivo binário");
+        return 0;
+    }
+
+    BinaryDatasetHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    // Em ordem: cada teste so usa somas e produtos que os anteriores garantem nao estourar
+    // (dims e count cabem em int, e cada trecho ja foi conferido contra o tamanho do arquivo)
+    unsigned long long bounds_size = 2 * sizeof(double) * (unsigned long long)header.dims;
+    unsigned long long offsets_size = header.count * sizeof(unsigned long long);
+    int valid = !memcmp(header.magic, BINARY_DATASET_MAGIC, sizeof(BINARY_DATASET_MAGIC)) &&
+                header.version == BINARY_DATASET_VERSION && header.byte_order == BYTE_ORDER_MARK &&
+                header.dims >= 1 && header.dims <= INT_MAX && header.count <= INT_MAX &&
+                fits_in_file(bounds_offset(), bounds_size, size) &&
+                header.columns_offset >= bounds_offset() + bounds_size && header.columns_offset <= size &&
+                header.dims <= (size - header.columns_offset) / (column_stride(&header) ? column_stride(&header) : 1) &&
+                header.label_offsets_offset >= column_offset(&header, header.dims) &&
+                fits_in_file(header.label_offsets_offset, offsets_size, size) &&
+                header.label_pool_offset >= header.label_offsets_offset + offsets_size &&
+                fits_in_file(header.label_pool_offset, header.label_pool_size, size) &&
+                (header.label_pool_size == 0 || data[header.label_pool_offset + header.label_pool_size - 1] == 0) &&
+                sizeof(size_t) == sizeof(unsigned long long);
+
+    // Todo rotulo precisa comecar dentro do pool (que termina em '\0'), senao dataset_label
+    // leria alem do mapeamento
+    const unsigned long long* label_offsets = (const unsigned long long*)(data + header.label_offsets_offset);
+    for(unsigned long long i = 0; valid && i < header.count; i++)
+        if(label_offsets[i] >= header.label_pool_size) valid = 0;
+
+    if(!valid){
+        fprintf(stderr, "Arquivo binário inválido ou de outra versão/arquitetura: %s\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+
+    int dims = header.dims, count = (int)header.count;
+    DataSet* dataset = (DataSet*)calloc(1, sizeof(DataSet));
+    if(!dataset){
+        perror("Falha ao alocar DataSet");
+        munmap(data, size);
+        return 0;
+    }
+
+    // So os clusters e os vetores pequenos sao alocados; o resto aponta pro mapeamento
+    dataset->mapping = data;
+    dataset->mapping_size = size;
+    dataset->dims = dims;
+    dataset->count = count;
+    dataset->capacity = count;
+    dataset->columns = (double**)malloc(sizeof(double*) * dims);
+    dataset->min = (double*)malloc(sizeof(double) * dims);
+    dataset->max = (double*)malloc(sizeof(double) * dims);
+    dataset->cluster_id = (int*)calloc(count > 0 ? count : 1, sizeof(int));
+    if(!dataset->columns || !dataset->min || !dataset->max || !dataset->cluster_id){
+        perror("Falha ao alocar DataSet");
+        free_dataset(dataset);
+        return 0;
+    }
+
+    memcpy(dataset->min, data + bounds_offset(), sizeof(double) * dims);
+    memcpy(dataset->max, data + bounds_offset() + sizeof(double) * dims, sizeof(double) * dims);
+    for(int d = 0; d < dims; d++) dataset->columns[d] = (double*)(data + column_offset(&header, d));
+    dataset->label_offset = (size_t*)(data + header.label_offsets_offset);
+    dataset->label_pool = data + header.label_pool_offset;
+    dataset->label_pool_size = header.label_pool_size;
+    dataset->label_pool_capacity = header.label_pool_size;
+
+    return dataset;
+}
@@ -0,0 +1,42 @@
+/* date = October 17th 2026 2:30 pm */
+
+#ifndef DATASET_BINARY_H
+#define DATASET_BINARY_H
+
+#include "data_loader.h"
+
+#define BINARY_DATASET_EXTENSION ".ccb"
+
+// Formato binario em colunas (.ccb), na ordem de bytes da maquina:
+//   cabecalho (BinaryDatasetHeader)
+//   min[dims], max[dims]                  limites de cada coordenada
+//   dims colunas de count doubles         cada uma alinhada em BINARY_DATASET_ALIGNMENT
+//   count offsets de 64 bits              inicio do rotulo de cada ponto no pool
+//   pool de rotulos                       strings terminadas em '\0'
+// O loader mapeia o arquivo e aponta as colunas do DataSet direto pra ele, sem parsing.
+
+#define BINARY_DATASET_MAGIC "CCLUBIN"
+#define BINARY_DATASET_VERSION 1
+#define BINARY_DATASET_ALIGNMENT 64
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order; // 0x01020304 escrito pela maquina que gerou o arquivo
+    unsigned int dims;
+    unsigned int reserved;
+    unsigned long long count;
+    unsigned long long columns_offset;
+    unsigned long long label_offsets_offset;
+    unsigned long long label_pool_offset;
+    unsigned long long label_pool_size;
+} BinaryDatasetHeader;
+
+int write_binary_dataset(const DataSet* dataset, const char* filename);
+
+DataSet* load_binary_dataset(const char* filename);
+
+// Verdadeiro se o nome termina com a extensao do formato binario
+int is_binary_dataset_file(const char* filename);
+
+#endif // DATASET_BINARY_H
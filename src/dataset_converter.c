@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "data_loader.h"
+#include "dataset_binary.h"
+
+// Converte um dataset em texto para o formato binario em colunas (.ccb)
+int main(int argc, char *argv[]){
+    if(argc < 3){
+        fprintf(stderr, "Uso: %s <entrada.txt> <saida%s>\n", argv[0], BINARY_DATASET_EXTENSION);
+        return EXIT_FAILURE;
+    }
+
+    DataSet* dataset = load_data_from_file(argv[1]);
+    if(!dataset){
+        fprintf(stderr, "Falha ao carregar os dados. Encerrando.\n");
+        return EXIT_FAILURE;
+    }
+
+    int ok = write_binary_dataset(dataset, argv[2]);
+    if(ok) printf("%d pontos com %d coordenadas gravados em %s\n", dataset->count, dataset->dims, argv[2]);
+
+    free_dataset(dataset);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
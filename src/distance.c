@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <pthread.h>
+#include "distance.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DISTANCE_X86 1
+#include <immintrin.h>
+#endif
+
+// Tamanho do bloco de centroides avaliado de uma vez em nearest_centroid
+#define CENTROID_BLOCK 256
+// Pontos por ladrilho no caminho generico: o acumulador do ladrilho fica no L1
+#define STRIDED_TILE 512
+
+typedef void (*BlockKernel)(const double* point, const double* const* columns, int dims, int offset, int m, double* out);
+
+// Resto do bloco que nao fecha um vetor: escalar, coordenada a coordenada
+static void block_tail(const double* point, const double* const* columns, int dims, int offset, int m, double* out){
+    for(int j = 0; j < m; j++){
+        double diff = columns[0][offset + j] - point[0];
+        double sum = diff * diff;
+        for(int d = 1; d < dims; d++){
+            diff = columns[d][offset + j] - point[d];
+            sum += diff * diff;
+        }
+        out[j] = sum;
+    }
+}
+
+// Gera, para um conjunto de instrucoes, o kernel de bloco com dois caminhos:
+//  - NAME##_fixed: D conhecido em tempo de compilacao (2, 3, 4, 8), laco das coordenadas
+//    desenrolado e a soma inteira em registrador;
+//  - NAME##_strided: D qualquer, percorre uma coluna por vez sobre ladrilhos de pontos.
+// Os dois somam as coordenadas na mesma ordem, entao o resultado e o mesmo.
+#define DEFINE_BLOCK_KERNEL(NAME, TARGET, VEC, WIDTH, SET1, LOADU, STOREU, SUB, MUL, ADD)          \
+TARGET static inline __attribute__((always_inline))                                                \
+void NAME##_fixed(const double* point, const double* const* columns, const int dims,               \
+                  int offset, int m, double* out){                                                 \
+    int j = 0;                                                                                     \
+    for(; j + WIDTH <= m; j += WIDTH){                                                             \
+        VEC diff = SUB(LOADU(columns[0] + offset + j), SET1(point[0]));                            \
+        VEC sum = MUL(diff, diff);                                                                 \
+        for(int d = 1; d < dims; d++){                                                             \
+            diff = SUB(LOADU(columns[d] + offset + j), SET1(point[d]));                            \
+            sum = ADD(sum, MUL(diff, diff));                                                       \
+        }                                                                                          \
+        STOREU(out + j, sum);                                                                      \
+    }                                                                                              \
+    block_tail(point, columns, dims, offset + j, m - j, out + j);                                  \
+}                                                                                                  \
+                                                                                                   \
+TARGET static void NAME##_strided(const double* point, const double* const* columns, int dims,     \
+                                  int offset, int m, double* out){                                 \
+    for(int start = 0; start < m; start += STRIDED_TILE){                                          \
+        int end = start + STRIDED_TILE < m ? start + STRIDED_TILE : m;                             \
+        for(int d = 0; d < dims; d++){                                                             \
+            const double* column = columns[d] + offset;                                            \
+            VEC coordinate = SET1(point[d]);                                                       \
+            int j = start;                                                                         \
+            for(; j + WIDTH <= end; j += WIDTH){                                                   \
+                VEC diff = SUB(LOADU(column + j), coordinate);                                     \
+                VEC square = MUL(diff, diff);                                                      \
+                STOREU(out + j, d ? ADD(LOADU(out + j), square) : square);                         \
+            }                                                                                      \
+            for(; j < end; j++){                                                                   \
+                double diff = column[j] - point[d];                                                \
+                out[j] = d ? out[j] + diff * diff : diff * diff;                                   \
+            }                                                                                      \
+        }                                                                                          \
+    }                                                                                              \
+}                                                                                                  \
+                                                                                                   \
+TARGET static void NAME(const double* point, const double* const* columns, int dims,               \
+                        int offset, int m, double* out){                                           \
+    switch(dims){                                                                                  \
+        case 2: NAME##_fixed(point, columns, 2, offset, m, out); break;                            \
+        case 3: NAME##_fixed(point, columns, 3, offset, m, out); break;                            \
+        case 4: NAME##_fixed(point, columns, 4, offset, m, out); break;                            \
+        case 8: NAME##_fixed(point, columns, 8, offset, m, out); break;                            \
+        default: NAME##_strided(point, columns, dims, offset, m, out); break;                      \
+    }                                                                                              \
+}
+
+#define SCALAR_SET1(x) (x)
+#define SCALAR_LOADU(p) (*(p))
+#define SCALAR_STOREU(p, v) (*(p) = (v))
+#define SCALAR_SUB(a, b) ((a) - (b))
+#define SCALAR_MUL(a, b) ((a) * (b))
+#define SCALAR_ADD(a, b) ((a) + (b))
+
+DEFINE_BLOCK_KERNEL(block_scalar, , double, 1, SCALAR_SET1, SCALAR_LOADU, SCALAR_STOREU,
+                    SCALAR_SUB, SCALAR_MUL, SCALAR_ADD)
+
+#ifdef DISTANCE_X86
+DEFINE_BLOCK_KERNEL(block_sse2, __attribute__((target("sse2"))), __m128d, 2, _mm_set1_pd, _mm_loadu_pd,
+                    _mm_storeu_pd, _mm_sub_pd, _mm_mul_pd, _mm_add_pd)
+
+DEFINE_BLOCK_KERNEL(block_avx2, __attribute__((target("avx2"))), __m256d, 4, _mm256_set1_pd, _mm256_loadu_pd,
+                    _mm256_storeu_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_add_pd)
+
+DEFINE_BLOCK_KERNEL(block_avx512, __attribute__((target("avx512f"))), __m512d, 8, _mm512_set1_pd, _mm512_loadu_pd,
+                    _mm512_storeu_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_add_pd)
+#endif
+
+static BlockKernel block_kernel = block_scalar;
+static const char* kernel_name = "escalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(void){
+#ifdef DISTANCE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")){
+        block_kernel = block_avx512;
+        kernel_name = "avx512";
+    } else if(__builtin_cpu_supports("avx2")){
+        block_kernel = block_avx2;
+        kernel_name = "avx2";
+    } else if(__builtin_cpu_supports("sse2")){
+        block_kernel = block_sse2;
+        kernel_name = "sse2";
+    }
+#endif
+}
+
+void squared_distances_to_block(const double* point, const double* const* columns, int dims, int offset, int m, double* out){
+    pthread_once(&kernel_once, select_kernel);
+    block_kernel(point, columns, dims, offset, m, out);
+}
+
+int nearest_centroid(const double* point, const double* const* centroid_columns, int dims, int k, double* smallest){
+    pthread_once(&kernel_once, select_kernel);
+
+    double distances[CENTROID_BLOCK];
+    double smallest_distance = 0;
+    int closest = -1;
+
+    for(int start = 0; start < k; start += CENTROID_BLOCK){
+        int m = k - start < CENTROID_BLOCK ? k - start : CENTROID_BLOCK;
+        block_kernel(point, centroid_columns, dims, start, m, distances);
+        for(int j = 0; j < m; j++){
+            if(closest != -1 && distances[j] > smallest_distance) continue;
+            smallest_distance = distances[j];
+            closest = start + j;
+        }
+    }
+
+    if(smallest) *smallest = smallest_distance;
+    return closest;
+}
+
+const char* distance_kernel_name(void){
+    pthread_once(&kernel_once, select_kernel);
+    return kernel_name;
+}
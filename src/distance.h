@@ -0,0 +1,24 @@
+/* date = October 17th 2026 11:15 am */
+
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+// Kernels de distancia euclidiana ao quadrado sobre coordenadas em colunas.
+// A implementacao (AVX-512, AVX2, SSE2 ou escalar) e escolhida uma vez, em tempo de
+// execucao, pelo que a CPU suporta. Todas dao exatamente o mesmo resultado: so somas e
+// produtos, sem FMA.
+
+// Os pontos vem em colunas (columns[d][i]) e o ponto de referencia como vetor de dims
+// coordenadas. Ha caminhos especializados para D = 2, 3, 4 e 8 e um generico para o resto.
+
+// out[j] = distancia de point ate o ponto offset + j das colunas, para j em [0, m)
+void squared_distances_to_block(const double* point, const double* const* columns, int dims, int offset, int m, double* out);
+
+// Centroide mais proximo de point entre os k dados (centroid_columns[d][c]); empate fica com
+// o de maior indice. Se smallest nao for NULL, recebe a distancia ate ele.
+int nearest_centroid(const double* point, const double* const* centroid_columns, int dims, int k, double* smallest);
+
+// Nome da implementacao escolhida ("avx512", "avx2", "sse2" ou "escalar")
+const char* distance_kernel_name(void);
+
+#endif // DISTANCE_H
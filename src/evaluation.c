@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "evaluation.h"
+#include "stats.h"
+
+#define EMPTY_KEY UINT64_MAX
+// Faixa de rotulos que ainda vale mapear por vetor direto em vez de hash
+#define DIRECT_RANGE_FACTOR 4
+// Contingencia densa ate k_A * k_B celulas por ponto (mais que isso fica esparsa demais)
+#define DENSE_CELLS_PER_POINT 4
+
+// Hash com enderecamento aberto: chave de 64 bits -> int
+typedef struct {
+    uint64_t* keys;
+    int* values;
+    size_t mask;
+} HashTable;
+
+static int create_table(HashTable* table, size_t entries){
+    size_t capacity = 16;
+    while(capacity < entries * 2) capacity <<= 1;
+    table->mask = capacity - 1;
+    table->keys = malloc(sizeof(uint64_t) * capacity);
+    table->values = malloc(sizeof(int) * capacity);
+    if(!table->keys || !table->values){
+        free(table->keys);
+        free(table->values);
+        return 0;
+    }
+    memset(table->keys, 0xff, sizeof(uint64_t) * capacity);
+    return 1;
+}
+
+static void free_table(HashTable* table){
+    free(table->keys);
+    free(table->values);
+}
+
+// Posicao da chave na tabela (ja ocupada por ela ou vazia)
+static size_t table_slot(const HashTable* table, uint64_t key){
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 17) & table->mask;
+    while(table->keys[slot] != EMPTY_KEY && table->keys[slot] != key) slot = (slot + 1) & table->mask;
+    return slot;
+}
+
+// Troca os rotulos por ids densos 0..k-1, na ordem em que aparecem. Devolve k, ou -1 sem memoria.
+static int dense_labels(const int* labels, int n, int* dense){
+    int min = labels[0], max = labels[0];
+    for(int i = 1; i < n; i++){
+        if(labels[i] < min) min = labels[i];
+        if(labels[i] > max) max = labels[i];
+    }
+
+    int k = 0;
+    long long range = (long long)max - min + 1;
+    if(range <= (long long)n * DIRECT_RANGE_FACTOR){
+        // Rotulos pequenos (o caso comum): vetor direto
+        int* ids = malloc(sizeof(int) * range);
+        if(!ids) return -1;
+        memset(ids, 0xff, sizeof(int) * range);
+        for(int i = 0; i < n; i++){
+            int* id = &ids[labels[i] - min];
+            if(*id < 0) *id = k++;
+            dense[i] = *id;
+        }
+        free(ids);
+        return k;
+    }
+
+    HashTable table;
+    if(!create_table(&table, n)) return -1;
+    for(int i = 0; i < n; i++){
+        uint64_t key = (uint32_t)labels[i];
+        size_t slot = table_slot(&table, key);
+        if(table.keys[slot] == EMPTY_KEY){
+            table.keys[slot] = key;
+            table.values[slot] = k++;
+        }
+        dense[i] = table.values[slot];
+    }
+    free_table(&table);
+    return k;
+}
+
+static double pairs(long long count){
+    return (double)count * (count - 1) / 2;
+}
+
+// Entropia de uma particao a partir do tamanho de cada cluster
+static double entropy(const int* sizes, int k, int n){
+    double h = 0;
+    for(int i = 0; i < k; i++)
+        if(sizes[i] > 0) h -= (double)sizes[i] / n * log((double)sizes[i] / n);
+    return h;
+}
+
+// Informacao mutua esperada entre particoes aleatorias com os mesmos tamanhos de cluster
+// (modelo hipergeometrico de Vinh et al.). Custa a soma de min(a_i, b_j) sobre os pares.
+static double expected_mutual_information(const int* sizes_a, int k_a, const int* sizes_b, int k_b, int n){
+    double log_n_factorial = lgamma(n + 1.0);
+    double emi = 0;
+    for(int i = 0; i < k_a; i++){
+        double a = sizes_a[i];
+        for(int j = 0; j < k_b; j++){
+            double b = sizes_b[j];
+            double start = a + b - n > 1 ? a + b - n : 1;
+            double end = a < b ? a : b;
+            double constant = lgamma(a + 1) + lgamma(b + 1) + lgamma(n - a + 1) + lgamma(n - b + 1) - log_n_factorial;
+            for(double nij = start; nij <= end; nij++){
+                double log_probability = constant - lgamma(nij + 1) - lgamma(a - nij + 1) - lgamma(b - nij + 1) - lgamma(n - a - b + nij + 1);
+                emi += nij / n * log(n * nij / (a * b)) * exp(log_probability);
+            }
+        }
+    }
+    return emi;
+}
+
+static int compute_agreement(const int* clusters_A, const int* clusters_B, int num_points, int with_ami, ClusterAgreement* agreement){
+    memset(agreement, 0, sizeof(ClusterAgreement));
+    if(clusters_A == NULL || clusters_B == NULL || num_points < 1) return 1;
+    int n = num_points;
+
+    int* dense = malloc(sizeof(int) * 2 * (size_t)n);
+    if(!dense) return 0;
+    int* dense_a = dense;
+    int* dense_b = dense + n;
+    int k_a = dense_labels(clusters_A, n, dense_a);
+    int k_b = k_a < 0 ? -1 : dense_labels(clusters_B, n, dense_b);
+    int* sizes = k_b < 0 ? NULL : calloc((size_t)k_a + k_b, sizeof(int));
+    if(!sizes){
+        free(dense);
+        return 0;
+    }
+    int* sizes_a = sizes;
+    int* sizes_b = sizes + k_a;
+    for(int i = 0; i < n; i++){
+        sizes_a[dense_a[i]]++;
+        sizes_b[dense_b[i]]++;
+    }
+
+    // Somas exatas em inteiros: cada soma de pares cabe em 64 bits (no maximo n^2 / 2)
+    long long sum_nij_pairs = 0;
+    double mutual_information = 0;
+
+    // Contingencia: densa se for pequena, senao so as celulas nao vazias num hash
+    long long cells = (long long)k_a * k_b;
+    int* dense_table = cells <= (long long)n * DENSE_CELLS_PER_POINT ? calloc(cells, sizeof(int)) : NULL;
+    HashTable table;
+    if(!dense_table && !create_table(&table, n)){
+        free(sizes);
+        free(dense);
+        return 0;
+    }
+
+    for(int i = 0; i < n; i++){
+        if(dense_table){
+            dense_table[(size_t)dense_a[i] * k_b + dense_b[i]]++;
+            continue;
+        }
+        uint64_t key = (uint64_t)dense_a[i] << 32 | (uint32_t)dense_b[i];
+        size_t slot = table_slot(&table, key);
+        if(table.keys[slot] == EMPTY_KEY){
+            table.keys[slot] = key;
+            table.values[slot] = 0;
+        }
+        table.values[slot]++;
+    }
+
+    size_t slots = dense_table ? (size_t)cells : table.mask + 1;
+    for(size_t s = 0; s < slots; s++){
+        int nij, a, b;
+        if(dense_table){
+            nij = dense_table[s];
+            a = (int)(s / k_b);
+            b = (int)(s % k_b);
+        } else{
+            if(table.keys[s] == EMPTY_KEY) continue;
+            nij = table.values[s];
+            a = (int)(table.keys[s] >> 32);
+            b = (int)(uint32_t)table.keys[s];
+        }
+        if(!nij) continue;
+        sum_nij_pairs += (long long)nij * (nij - 1) / 2;
+        mutual_information += (double)nij / n * log((double)n * nij / ((double)sizes_a[a] * sizes_b[b]));
+    }
+
+    if(dense_table) free(dense_table);
+    else free_table(&table);
+
+    long long sum_a_pairs = 0, sum_b_pairs = 0;
+    for(int i = 0; i < k_a; i++) sum_a_pairs += (long long)sizes_a[i] * (sizes_a[i] - 1) / 2;
+    for(int j = 0; j < k_b; j++) sum_b_pairs += (long long)sizes_b[j] * (sizes_b[j] - 1) / 2;
+
+    agreement->clusters_a = k_a;
+    agreement->clusters_b = k_b;
+
+    // ARI = (Index - ExpectedIndex) / (MaxIndex - ExpectedIndex); o produto vai em double
+    double total_pairs = pairs(n);
+    double expected_index = total_pairs > 0 ? (double)sum_a_pairs * sum_b_pairs / total_pairs : 0;
+    double max_index = 0.5 * ((double)sum_a_pairs + sum_b_pairs);
+    double numerator = sum_nij_pairs - expected_index;
+    double denominator = max_index - expected_index;
+    agreement->ari = denominator == 0 ? (numerator == 0 ? 1.0 : 0.0) : numerator / denominator;
+
+    agreement->fowlkes_mallows = sum_a_pairs && sum_b_pairs ? sum_nij_pairs / sqrt((double)sum_a_pairs * sum_b_pairs) : 0;
+
+    // Uma particao com um cluster so (ou so singletons nas duas) nao tem informacao a comparar
+    double h_a = entropy(sizes_a, k_a, n), h_b = entropy(sizes_b, k_b, n);
+    double mean_entropy = 0.5 * (h_a + h_b);
+    int trivial = (k_a == 1 && k_b == 1) || (k_a == n && k_b == n);
+    if(mutual_information < 0) mutual_information = 0;
+    agreement->nmi = trivial ? 1.0 : mean_entropy > 0 ? mutual_information / mean_entropy : 0;
+
+    if(with_ami){
+        if(trivial) agreement->ami = 1.0;
+        else{
+            double emi = expected_mutual_information(sizes_a, k_a, sizes_b, k_b, n);
+            double ami_denominator = mean_entropy - emi;
+            if(fabs(ami_denominator) < DBL_EPSILON) ami_denominator = ami_denominator < 0 ? -DBL_EPSILON : DBL_EPSILON;
+            agreement->ami = (mutual_information - emi) / ami_denominator;
+        }
+    }
+
+    free(sizes);
+    free(dense);
+    return 1;
+}
+
+int cluster_agreement(const int* clusters_A, const int* clusters_B, int num_points, int with_ami, ClusterAgreement* agreement){
+    STATS_TIMER_BEGIN(start);
+    int ok = compute_agreement(clusters_A, clusters_B, num_points, with_ami, agreement);
+    STATS_TIMER_END(TIMER_EVALUATION, start);
+    return ok;
+}
+
+double adjusted_rand_index(const int* clusters_A, const int* clusters_B, int num_points){
+    if(clusters_A == NULL || clusters_B == NULL || num_points == 0) return 0.0;
+    ClusterAgreement agreement;
+    if(!cluster_agreement(clusters_A, clusters_B, num_points, 0, &agreement)) return 0.0;
+    return agreement.ari;
+}
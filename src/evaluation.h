@@ -0,0 +1,24 @@
+/* date = October 17th 2026 4:05 pm */
+
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+// Comparacao de duas particoes dos mesmos pontos. Os rotulos podem ser inteiros quaisquer
+// (negativos ou enormes): sao trocados por ids densos e a tabela de contingencia so guarda
+// as celulas nao vazias, entao tudo e O(n) em tempo e memoria.
+typedef struct {
+    double ari; // indice Rand ajustado
+    double nmi; // informacao mutua normalizada pela media das entropias
+    double ami; // informacao mutua ajustada ao acaso (so se pedida: custa mais que O(n))
+    double fowlkes_mallows;
+    int clusters_a; // clusters distintos em cada particao
+    int clusters_b;
+} ClusterAgreement;
+
+// Preenche agreement com todas as medidas a partir de uma unica tabela de contingencia.
+// Devolve 0 se faltar memoria.
+int cluster_agreement(const int* clusters_A, const int* clusters_B, int num_points, int with_ami, ClusterAgreement* agreement);
+
+double adjusted_rand_index(const int* clusters_A, const int* clusters_B, int num_points);
+
+#endif // EVALUATION_H
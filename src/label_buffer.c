@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "label_buffer.h"
+
+// Bit da copia do meio que diz que ela ainda nao foi lida
+#define LABEL_BUFFER_FRESH 4
+
+LabelBuffer* create_label_buffer(int count){
+    LabelBuffer* buffer = malloc(sizeof(LabelBuffer));
+    if(!buffer) return NULL;
+
+    buffer->count = count;
+    for(int s = 0; s < 3; s++){
+        buffer->slots[s].cluster_id = malloc(sizeof(int) * (count > 0 ? count : 1));
+        if(!buffer->slots[s].cluster_id){
+            while(s--) free(buffer->slots[s].cluster_id);
+            free(buffer);
+            return NULL;
+        }
+        for(int i = 0; i < count; i++) buffer->slots[s].cluster_id[i] = -1;
+        buffer->slots[s].step = 0;
+        buffer->slots[s].score = NAN;
+    }
+    buffer->back = 0;
+    buffer->middle = 1;
+    buffer->front = 2;
+    return buffer;
+}
+
+void publish_labels(LabelBuffer* buffer, const int* cluster_id, int step, double score){
+    LabelSnapshot* slot = &buffer->slots[buffer->back];
+    memcpy(slot->cluster_id, cluster_id, sizeof(int) * buffer->count);
+    slot->step = step;
+    slot->score = score;
+
+    // A escrita acima fica visivel para quem pegar essa copia (release/acquire)
+    int previous = __atomic_exchange_n(&buffer->middle, buffer->back | LABEL_BUFFER_FRESH, __ATOMIC_ACQ_REL);
+    buffer->back = previous & ~LABEL_BUFFER_FRESH;
+}
+
+const LabelSnapshot* acquire_labels(LabelBuffer* buffer, bool* fresh){
+    *fresh = false;
+    if(__atomic_load_n(&buffer->middle, __ATOMIC_RELAXED) & LABEL_BUFFER_FRESH){
+        int previous = __atomic_exchange_n(&buffer->middle, buffer->front, __ATOMIC_ACQ_REL);
+        buffer->front = previous & ~LABEL_BUFFER_FRESH;
+        *fresh = true;
+    }
+    return &buffer->slots[buffer->front];
+}
+
+void free_label_buffer(LabelBuffer* buffer){
+    if(!buffer) return;
+    for(int s = 0; s < 3; s++) free(buffer->slots[s].cluster_id);
+    free(buffer);
+}
@@ -0,0 +1,40 @@
+/* date = October 17th 2026 10:15 pm */
+
+#ifndef LABEL_BUFFER_H
+#define LABEL_BUFFER_H
+
+#include "data_loader.h"
+
+// Rotulos publicados por uma thread (o algoritmo) e lidos por outra (o visualizador) sem
+// trava e sem ninguem esperar: o produtor escreve na sua copia e a troca com a do meio; o
+// consumidor troca a sua com a do meio quando ha novidade. E o buffer duplo com uma copia
+// a mais, para o produtor nunca precisar esperar a leitura acabar. So um produtor e um
+// consumidor; rotulos intermediarios que ninguem leu a tempo sao descartados.
+
+typedef struct {
+    int* cluster_id;
+    int step; // etapa do algoritmo (ver ClusteringProgress)
+    double score; // ARI do resultado final; NAN enquanto roda
+} LabelSnapshot;
+
+typedef struct {
+    LabelSnapshot slots[3];
+    int count;
+    int back; // do produtor
+    int front; // do consumidor
+    int middle; // indice da copia do meio | LABEL_BUFFER_FRESH; so por operacoes atomicas
+} LabelBuffer;
+
+// Todas as copias comecam com -1 (sem cluster)
+LabelBuffer* create_label_buffer(int count);
+
+// Produtor: copia os rotulos e publica, sem esperar
+void publish_labels(LabelBuffer* buffer, const int* cluster_id, int step, double score);
+
+// Consumidor: a publicacao mais recente (ou a mesma da ultima chamada, com fresh = false).
+// O ponteiro vale ate a proxima chamada.
+const LabelSnapshot* acquire_labels(LabelBuffer* buffer, bool* fresh);
+
+void free_label_buffer(LabelBuffer* buffer);
+
+#endif // LABEL_BUFFER_H
@@ -1,24 +1,237 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "data_loader.h"
+#include "dataset_binary.h"
 #include "x11_plotter.h"
 #include "clustering.h"
+#include "evaluation.h"
+#include "cluster_writer.h"
+#include "clu_io.h"
+#include "batch.h"
+#include "stats.h"
 
 #define INITIAL_WINDOW_WIDTH 800
 #define INITIAL_WINDOW_HEIGHT 600
 
+// Compara o agrupamento atual com o gabarito direto na memoria e, se houver gravador,
+// agenda o .clu em segundo plano. Devolve o ARI (ou ari, sem gabarito).
+static double report_clustering(const DataSet* dataset, const int* clusters_ref, ClusterWriter* writer,
+                                const char* dataset_name, int chosen_algorithm, int k, double ari){
+    if(writer){
+        char path[1 << 8];
+        clu_result_path(path, sizeof(path), CLU_RESULTS_DIR, dataset_name, chosen_algorithm, k);
+        queue_clusters(writer, dataset->cluster_id, path);
+    }
+    if(!clusters_ref) return ari;
+    
+    ClusterAgreement agreement;
+    cluster_agreement(dataset->cluster_id, clusters_ref, dataset->count, 0, &agreement);
+    printf("Índice Rand Ajustado (ARI) calculado para k = %d: %f\n", k, agreement.ari);
+    printf("NMI: %f, Fowlkes-Mallows: %f\n", agreement.nmi, agreement.fowlkes_mallows);
+    return agreement.ari;
+}
+
+// Abre a janela X11 com o agrupamento atual e libera o dataset ao fechar
+static int show_dataset(DataSet* dataset, const char* data_filename, double ari){
+    printf("Inicializando X11 para visualização...\n");
+    char window_title[128];
+    snprintf(window_title, 128, "Visualizador de Dados: %s", data_filename);
+    
+    X11Context* x_context = init_x11(window_title, INITIAL_WINDOW_WIDTH, INITIAL_WINDOW_HEIGHT);
+    if(!x_context){
+        fprintf(stderr, "Falha ao inicializar o X11. Encerrando.\n");
+        free_dataset(dataset);
+        return EXIT_FAILURE;
+    }
+    
+    initialize_cluster_colors(x_context);
+    
+    
+    printf("Exibindo dados. Pressione 'q' na janela para sair.\n");
+    run_x11_event_loop(x_context, dataset, ari);
+    
+    printf("Fechando X11 e liberando recursos...\n");
+    close_x11(x_context);
+    free_dataset(dataset);
+    
+    printf("Programa finalizado com sucesso.\n");
+    return EXIT_SUCCESS;
+}
+
+// Acompanhamento dos algoritmos: cada etapa vai para a janela; fechar a janela interrompe
+static bool publish_progress(void* data, const int* cluster_id, int count, int step){
+    (void)count;
+    X11Viewer* viewer = (X11Viewer*)data;
+    publish_to_viewer(viewer, cluster_id, step, NAN);
+    return !x11_viewer_closed(viewer);
+}
+
+// Mostra o agrupamento final na janela que acompanhou a execucao e espera ela fechar
+static int finish_viewer(X11Viewer* viewer, DataSet* dataset, double ari){
+    publish_to_viewer(viewer, dataset->cluster_id, 0, ari);
+    if(!x11_viewer_closed(viewer)) printf("Exibindo dados. Pressione 'q' na janela para sair.\n");
+    join_x11_viewer(viewer);
+    
+    printf("Fechando X11 e liberando recursos...\n");
+    free_dataset(dataset);
+    printf("Programa finalizado com sucesso.\n");
+    return EXIT_SUCCESS;
+}
+
+static void print_usage(const char* program){
+    fprintf(stderr,
+            "Uso: %s <arquivo_dados | arquivo.clu>\n"
+            "     %s <arquivo_dados> -a <algoritmo> -k <k | k_min-k_max> [opcoes]\n"
+            "     %s --manifest <arquivo> [opcoes]\n"
+            "Opcoes:\n"
+            "  -a, --algorithm <n|nome>  1-9 ou kmeans, single, complete, average, weighted,\n"
+            "                            ward, centroid, median, minibatch\n"
+            "  -k, --k <k|k_min-k_max>   numero de clusters (ou intervalo)\n"
+            "  -i, --iterations <n>      iteracoes do k-medias / lotes do k-medias em lotes\n"
+            "  -t, --threads <n>         threads de cada tarefa (0 = todos os nucleos)\n"
+            "  -s, --seed <n>            semente dos sorteios\n"
+            "  -r, --restarts <n>        inicializacoes k-means++ (0 = pontos fixos)\n"
+            "  -b, --batch-size <n>      pontos por lote do k-medias em lotes\n"
+            "  -o, --output <pasta>      grava os .clu nessa pasta\n"
+            "      --references <pasta>  pasta dos gabaritos (padrao " CLU_RESULTS_DIR ")\n"
+            "  -w, --workers <n>         tarefas simultaneas do manifesto (0 = todos os nucleos)\n"
+            "  -m, --manifest <arquivo>  uma tarefa por linha: <dataset> <algoritmo> <k> [k_max]\n"
+            "      --no-gui              nao abre a janela X11 no fim\n"
+            "O k-medias em lotes sem janela le o arquivo em lotes, sem carrega-lo inteiro; com\n"
+            "arquivo_dados \"-\" le a entrada padrao no modo online (cada lote e rotulado e\n"
+            "depois ensina o modelo).\n",
+            program, program, program);
+}
+
+// Linha de comando sem perguntas: uma tarefa (e a janela, sem --no-gui) ou um manifesto
+// de tarefas rodando em paralelo, sempre sem janela
+static int run_command_line(int argc, char* argv[]){
+    BatchOptions options = batch_default_options();
+    BatchJob job;
+    memset(&job, 0, sizeof(job));
+    const char* manifest = NULL;
+    const char* data_filename = NULL;
+    int show_gui = 1;
+    
+    for(int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        if(arg[0] != '-' || !arg[1]){
+            if(data_filename){
+                fprintf(stderr, "Mais de um arquivo de dados: %s\n", arg);
+                return EXIT_FAILURE;
+            }
+            data_filename = arg;
+            continue;
+        }
+        if(!strcmp(arg, "--no-gui")){
+            show_gui = 0;
+            continue;
+        }
+        if(!strcmp(arg, "-h") || !strcmp(arg, "--help")){
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        
+        // As demais opcoes levam um valor
+        if(i + 1 >= argc){
+            fprintf(stderr, "Falta o valor de %s\n", arg);
+            return EXIT_FAILURE;
+        }
+        const char* value = argv[++i];
+        
+        if(!strcmp(arg, "-a") || !strcmp(arg, "--algorithm")){
+            job.algorithm = parse_algorithm(value);
+            if(!job.algorithm){
+                fprintf(stderr, "Algoritmo desconhecido: %s\n", value);
+                return EXIT_FAILURE;
+            }
+        }
+        else if(!strcmp(arg, "-k") || !strcmp(arg, "--k")){
+            int fields = sscanf(value, "%d-%d", &job.k_min, &job.k_max);
+            if(fields == 1) job.k_max = job.k_min;
+            if(fields < 1 || job.k_min < 1 || job.k_max < job.k_min){
+                fprintf(stderr, "Valor de k invalido: %s\n", value);
+                return EXIT_FAILURE;
+            }
+        }
+        else if(!strcmp(arg, "-i") || !strcmp(arg, "--iterations")) options.iteration_limit = atoi(value);
+        else if(!strcmp(arg, "-t") || !strcmp(arg, "--threads")) options.n_threads = atoi(value);
+        else if(!strcmp(arg, "-s") || !strcmp(arg, "--seed")) options.seed = strtoull(value, NULL, 10);
+        else if(!strcmp(arg, "-r") || !strcmp(arg, "--restarts")) options.n_restarts = atoi(value);
+        else if(!strcmp(arg, "-b") || !strcmp(arg, "--batch-size")) options.batch_size = atoi(value);
+        else if(!strcmp(arg, "-o") || !strcmp(arg, "--output")) options.output_dir = value;
+        else if(!strcmp(arg, "--references")) options.reference_dir = value;
+        else if(!strcmp(arg, "-w") || !strcmp(arg, "--workers")) options.n_workers = atoi(value);
+        else if(!strcmp(arg, "-m") || !strcmp(arg, "--manifest")) manifest = value;
+        else {
+            fprintf(stderr, "Opcao desconhecida: %s\n", arg);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if(options.iteration_limit < 1 || options.batch_size < 1 || options.n_threads < 0 || options.n_workers < 0){
+        fprintf(stderr, "Iteracoes, tamanho do lote e threads precisam ser positivos.\n");
+        return EXIT_FAILURE;
+    }
+    
+    if(manifest){
+        if(data_filename){
+            fprintf(stderr, "Use um arquivo de dados ou um manifesto, nao os dois.\n");
+            return EXIT_FAILURE;
+        }
+        int count = 0;
+        BatchJob* jobs = load_manifest(manifest, &count);
+        if(!jobs) return EXIT_FAILURE;
+        
+        print_batch_header();
+        int failures = count ? run_batch(jobs, count, &options) : 0;
+        free(jobs);
+        if(failures) fprintf(stderr, "%d de %d tarefas falharam.\n", failures, count);
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    
+    if(!data_filename || !job.algorithm || !job.k_min){
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if(strlen(data_filename) >= sizeof(job.dataset)){
+        fprintf(stderr, "Caminho muito longo: %s\n", data_filename);
+        return EXIT_FAILURE;
+    }
+    strcpy(job.dataset, data_filename);
+    if(show_gui && !strcmp(data_filename, "-")){
+        fprintf(stderr, "A entrada padrao so pode ser lida sem janela (--no-gui).\n");
+        return EXIT_FAILURE;
+    }
+    
+    // Uma tarefa so: as threads vao todas para ela
+    print_batch_header();
+    DataSet* dataset = NULL;
+    double ari = 1.0;
+    STATS_RESET();
+    int ok = run_batch_job(&job, &options, show_gui ? &dataset : NULL, &ari);
+    print_job_stats(&job);
+    if(!ok) return EXIT_FAILURE;
+    
+    return show_gui ? show_dataset(dataset, data_filename, ari) : EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]){
     if(argc < 2){
-        fprintf(stderr, "Uso: %s <arquivo_dados>\n", argv[0]);
+        print_usage(argv[0]);
         return EXIT_FAILURE;
     }
+    if(argc > 2 || argv[1][0] == '-') return run_command_line(argc, argv);
     
     const char* data_filename = argv[1];
     
     // ------------------------ <<< PROGRAMA PRINCIPAL >>> ------------------------
     DataSet* dataset = 0;
     double ari = 1.0;
+    X11Viewer* viewer = NULL;
     
     char* filename_start = (char*)data_filename + strlen(data_filename);
     while(*--filename_start != '/');
@@ -33,13 +246,23 @@ int main(int argc, char *argv[]){
     
     if(!strcmp(data_filename + strlen(data_filename) - 3, "clu")){
         char dataset_path[1 << 8];
-        sprintf(dataset_path, "../data/%s.txt", chosen_file);
+        // Prefere a versao binaria do dataset, se tiver sido gerada
+        sprintf(dataset_path, "../data/%s" BINARY_DATASET_EXTENSION, chosen_file);
+        FILE* binary = fopen(dataset_path, "rb");
+        if(binary) fclose(binary);
+        else sprintf(dataset_path, "../data/%s.txt", chosen_file);
         dataset = load_data_from_file(dataset_path);
+        if(!dataset){
+            fprintf(stderr, "Falha ao carregar os dados. Encerrando.\n");
+            return EXIT_FAILURE;
+        }
         
-        int* real_clusters = load_clusters(data_filename, dataset->count);
-        
-        for(int i = 0; i < dataset->count; i++)
-            dataset->points[i].cluster_id = real_clusters[i];
+        // Casado pelo rotulo: o .clu nao precisa estar na ordem do dataset
+        int* real_clusters = load_clusters_for_dataset(data_filename, dataset);
+        if(real_clusters){
+            memcpy(dataset->cluster_id, real_clusters, sizeof(int) * dataset->count);
+            free_clusters(real_clusters);
+        }
     }
     else {
         printf("Carregando dados de: %s\n", data_filename);
@@ -72,15 +295,16 @@ int main(int argc, char *argv[]){
         
         int chosen_algorithm = 0;
         while(1){
-            printf("1 - k-médias\n2 - single-link\n3 - complete-link\n");
+            printf("1 - k-médias\n2 - single-link\n3 - complete-link\n4 - average-link\n"
+                   "5 - weighted-link\n6 - ward\n7 - centroid-link\n8 - median-link\n9 - k-médias em lotes\n");
             
             scanf("%d", &chosen_algorithm);
-            if(chosen_algorithm >= 1 && chosen_algorithm <= 3) break;
+            if(chosen_algorithm >= 1 && chosen_algorithm <= 9) break;
             
             printf("Escolha uma opção válida.\n");
         }
         
-        int is_link = chosen_algorithm > 1;
+        int is_link = chosen_algorithm > 1 && chosen_algorithm < 9;
         
         int arg1 = 0, arg2 = 0;
         printf(message[0][is_link]);
@@ -88,73 +312,110 @@ int main(int argc, char *argv[]){
         printf(message[1][is_link]);
         scanf("%d", &arg2);
         
-        if(chosen_algorithm == 1){
-            k_means(dataset, arg1, arg2);
-            write_clu(dataset, chosen_file, arg1, chosen_algorithm);
-        }
-        
-        else if(chosen_algorithm == 2){
-            for(int i = arg1; i <= arg2; i++){
-                single_link(dataset, i);
-                write_clu(dataset, chosen_file, i, chosen_algorithm);
-            }
-        }
-        
-        else{
-            for(int i = arg1; i <= arg2; i++){
-                complete_link(dataset, i);
-                write_clu(dataset, chosen_file, i, chosen_algorithm);
-            }
-        }
+        int save_results = 0;
+        printf("Deseja salvar os resultados em arquivos .clu? (1 = sim, 0 = não)\n");
+        scanf("%d", &save_results);
         
+        // Os resultados ficam na memoria e sao avaliados direto contra o gabarito
         char ref_filename[1 << 8];
-        char group_filename[1 << 8];
-        
         snprintf(ref_filename, 1 << 8, "../data/resultados/%s.clu", chosen_file);
         printf("Carregando clusters de referência de %s...\n", ref_filename);
-        int* clusters_ref = load_clusters(ref_filename, dataset->count);
+        int* clusters_ref = load_clusters_for_dataset(ref_filename, dataset);
+        if(!clusters_ref) printf("Não foi possível carregar os clusters de referência. O ARI não será calculado.\n");
+        
+        // A janela abre antes do agrupamento e mostra cada etapa enquanto o algoritmo roda;
+        // fechar a janela no meio interrompe o algoritmo. Sem display, segue sem janela
+        // (e a falha aparece no fim, como antes).
+        printf("Inicializando X11 para acompanhar o agrupamento...\n");
+        char window_title[128];
+        snprintf(window_title, 128, "Visualizador de Dados: %s", data_filename);
+        viewer = start_x11_viewer(window_title, INITIAL_WINDOW_WIDTH, INITIAL_WINDOW_HEIGHT, dataset);
+        ClusteringProgress progress;
+        progress.callback = viewer ? publish_progress : NULL;
+        progress.data = viewer;
+        progress.every = 0;
         
-        if(!is_link) arg2 = arg1;
-        for(int i = arg1; i <= arg2; i++){
-            snprintf(group_filename, 1 << 8, "../data/resultados/G1_%s_%d_%d.clu", chosen_file, chosen_algorithm, i);
+        ClusterWriter* writer = save_results ? start_cluster_writer(dataset) : NULL;
+        int failed = 0;
+        STATS_RESET();
+        
+        if(chosen_algorithm == 1){
+            KMeansOptions options = kmeans_default_options(arg1, arg2);
+            printf("Quantas threads deseja usar? (0 = todos os núcleos)\n");
+            scanf("%d", &options.n_threads);
             
-            printf("Carregando clusters produzidos...\n");
-            int* clusters_prod = load_clusters(group_filename, dataset->count);
+            int n_restarts = 0;
+            printf("Quantas inicializações k-means++ deseja testar? (0 = pontos fixos)\n");
+            scanf("%d", &n_restarts);
+            if(n_restarts > 0){
+                options.seeding = KMEANS_SEED_AUTO;
+                options.n_restarts = n_restarts;
+            }
+            options.progress = progress;
             
-            if (clusters_ref && clusters_prod) {
-                ari = adjusted_rand_index(clusters_prod, clusters_ref, dataset->count);
-                printf("Índice Rand Ajustado (ARI) calculado para k = %d: %f\n", i, ari);
-                
-                free(clusters_prod);
+            k_means_with_options(dataset, &options);
+            if(x11_viewer_closed(viewer)){
+                printf("Janela fechada: k-médias interrompido.\n");
+                failed = 1;
+            }
+            else ari = report_clustering(dataset, clusters_ref, writer, chosen_file, chosen_algorithm, arg1, ari);
+        }
+        
+        else if(chosen_algorithm == 9){
+            // Treina lendo o arquivo em lotes; os pontos ja estao carregados so porque a
+            // janela precisa deles (sem janela, ver run_batch_job, nada e carregado inteiro)
+            int batch_size = 0;
+            printf("Quantos pontos por lote?\n");
+            scanf("%d", &batch_size);
+            MiniBatchOptions options = mini_batch_default_options(arg1, batch_size > 0 ? batch_size : 1, arg2);
+            options.n_threads = 0;
+            
+            KMeansModel* model = mini_batch_k_means(data_filename, &options);
+            if(!model){
+                fprintf(stderr, "Falha no k-médias em lotes. Encerrando.\n");
+                failed = 1;
+            } else {
+                kmeans_model_assign(model, dataset, 0);
+                free_kmeans_model(model);
+                ari = report_clustering(dataset, clusters_ref, writer, chosen_file, chosen_algorithm, arg1, ari);
+            }
+        }
+        
+        else{
+            // O dendrograma é calculado uma vez só; cada k é só um corte
+            // (as opções 2 a 8 seguem a ordem do enum Linkage)
+            Dendrogram* dendrogram = hac_dendrogram_with_progress(dataset, (Linkage)(chosen_algorithm - 2), &progress);
+            if(!dendrogram){
+                if(x11_viewer_closed(viewer)) printf("Janela fechada: agrupamento hierárquico interrompido.\n");
+                else fprintf(stderr, "Falha ao construir o dendrograma. Encerrando.\n");
+                failed = 1;
             } else {
-                printf("Não foi possível carregar os clusters de referência. O ARI não será calculado.\n");
+                // Enquanto um .clu e gravado, o proximo corte ja esta sendo avaliado
+                for(int i = arg1; i <= arg2; i++){
+                    cut_dendrogram(dendrogram, i, dataset);
+                    ari = report_clustering(dataset, clusters_ref, writer, chosen_file, chosen_algorithm, i, ari);
+                }
+                free_dendrogram(dendrogram);
             }
         }
         
+        if(finish_cluster_writer(writer)) fprintf(stderr, "Aviso: alguns arquivos .clu não foram gravados.\n");
         free_clusters(clusters_ref);
+        
+        BatchJob run;
+        snprintf(run.dataset, sizeof(run.dataset), "%s", data_filename);
+        run.algorithm = chosen_algorithm;
+        run.k_min = arg1;
+        run.k_max = is_link ? arg2 : arg1;
+        print_job_stats(&run);
+        if(failed){
+            int interrupted = x11_viewer_closed(viewer);
+            join_x11_viewer(viewer);
+            free_dataset(dataset);
+            return interrupted ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
     }
     
-    
-    printf("Inicializando X11 para visualização...\n");
-    char window_title[128];
-    snprintf(window_title, 128, "Visualizador de Dados: %s", data_filename);
-    
-    X11Context* x_context = init_x11(window_title, INITIAL_WINDOW_WIDTH, INITIAL_WINDOW_HEIGHT);
-    if(!x_context){
-        fprintf(stderr, "Falha ao inicializar o X11. Encerrando.\n");
-        return EXIT_FAILURE;
-    }
-    
-    initialize_cluster_colors(x_context);
-    
-    
-    printf("Exibindo dados. Pressione 'q' na janela para sair.\n");
-    run_x11_event_loop(x_context, dataset, ari);
-    
-    printf("Fechando X11 e liberando recursos...\n");
-    close_x11(x_context);
-    free_dataset(dataset);
-    
-    printf("Programa finalizado com sucesso.\n");
-    return EXIT_SUCCESS;
+    if(viewer) return finish_viewer(viewer, dataset, ari);
+    return show_dataset(dataset, data_filename, ari);
 }
@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+
+// Conjunto fixo de threads, criado na primeira chamada e reaproveitado ate o fim do
+// programa. Cada parallel_for entra numa fila com os seus blocos; as threads do conjunto
+// e a propria thread que chamou pegam os blocos sem dono. Quem chamou sempre pode rodar
+// todos os seus blocos sozinho, entao chamadas aninhadas (reinicios do k-medias) ou
+// simultaneas (tarefas do lote) nao travam esperando threads ocupadas.
+typedef struct ParallelCall {
+    ParallelTask task;
+    void* context;
+    int count;
+    int n_chunks;
+    int next_chunk; // proximo bloco sem dono
+    int pending; // blocos sem dono ou rodando
+    struct ParallelCall* next;
+} ParallelCall;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static ParallelCall* queue; // chamadas com blocos sem dono; a mais nova primeiro
+
+int available_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// Com pool_lock: pega o proximo bloco da chamada e a tira da fila se acabaram
+static int claim_chunk(ParallelCall* call) {
+    int chunk = call->next_chunk++;
+    if (call->next_chunk == call->n_chunks) {
+        ParallelCall** link = &queue;
+        while (*link != call) link = &(*link)->next;
+        *link = call->next;
+    }
+    return chunk;
+}
+
+// Roda o bloco sem pool_lock e devolve com ele
+static void run_chunk(ParallelCall* call, int chunk) {
+    pthread_mutex_unlock(&pool_lock);
+    int begin = (int)((long long)call->count * chunk / call->n_chunks);
+    int end = (int)((long long)call->count * (chunk + 1) / call->n_chunks);
+    call->task(call->context, chunk, begin, end);
+    pthread_mutex_lock(&pool_lock);
+    if (--call->pending == 0) pthread_cond_broadcast(&work_done);
+}
+
+static void* pool_worker(void* argument) {
+    (void)argument;
+    pthread_mutex_lock(&pool_lock);
+    while (1) {
+        while (!queue) pthread_cond_wait(&work_ready, &pool_lock);
+        ParallelCall* call = queue;
+        run_chunk(call, claim_chunk(call));
+    }
+    return NULL;
+}
+
+// Uma thread a menos que os nucleos: quem chama parallel_for tambem trabalha. Se alguma
+// nao subir, os blocos sao rodados por quem chamou.
+static void start_pool(void) {
+    int n_workers = available_threads() - 1;
+    for (int t = 0; t < n_workers; t++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_worker, NULL)) break;
+        pthread_detach(thread);
+    }
+}
+
+void parallel_for(int n_threads, int count, ParallelTask task, void* context) {
+    if (n_threads < 1) n_threads = 1;
+    
+    if (n_threads == 1) {
+        task(context, 0, 0, count);
+        return;
+    }
+    pthread_once(&pool_once, start_pool);
+    
+    ParallelCall call;
+    call.task = task;
+    call.context = context;
+    call.count = count;
+    call.n_chunks = n_threads;
+    call.next_chunk = 0;
+    call.pending = n_threads;
+    
+    pthread_mutex_lock(&pool_lock);
+    call.next = queue;
+    queue = &call;
+    pthread_cond_broadcast(&work_ready);
+    
+    // Roda os blocos que ninguem pegou e espera os que estao com as outras threads
+    while (call.next_chunk < call.n_chunks) run_chunk(&call, claim_chunk(&call));
+    while (call.pending > 0) pthread_cond_wait(&work_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
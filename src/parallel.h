@@ -0,0 +1,17 @@
+/* date = October 17th 2026 9:40 am */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Tarefa executada por cada thread sobre o intervalo [begin, end) dos itens
+typedef void (*ParallelTask)(void* context, int thread_index, int begin, int end);
+
+// Quantidade de nucleos disponiveis (no minimo 1)
+int available_threads(void);
+
+// Divide [0, count) em n_threads blocos contiguos e fixos (thread_index = numero do bloco),
+// rodados pelo conjunto de threads do programa (criado na primeira chamada) e por quem chamou.
+// A divisao so depende de count e n_threads, entao os resultados sao reproduziveis.
+void parallel_for(int n_threads, int count, ParallelTask task, void* context);
+
+#endif // PARALLEL_H
@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+
+#ifdef CCLUSTERING_STATS
+
+#include <time.h>
+#include "distance.h"
+
+static const char* counter_names[STAT_COUNTER_COUNT] = {
+    "distances", "kmeans_runs", "kmeans_iterations", "kmeans_limit_hits", "moved_points",
+    "mini_batches", "merges", "matrix_updates"
+};
+
+static const char* timer_names[STAT_TIMER_COUNT] = {
+    "kmeans_seeding", "kmeans_iterations", "mini_batch", "hac_matrix", "hac_merge", "cut",
+    "evaluation", "write_clu"
+};
+
+static long long counters[STAT_COUNTER_COUNT];
+static long long timer_nanoseconds[STAT_TIMER_COUNT]; // inteiros: a soma atomica e exata
+static long long tracked_bytes;
+static long long peak_bytes;
+
+void stats_reset(void){
+    for(int c = 0; c < STAT_COUNTER_COUNT; c++) __atomic_store_n(&counters[c], 0, __ATOMIC_RELAXED);
+    for(int t = 0; t < STAT_TIMER_COUNT; t++) __atomic_store_n(&timer_nanoseconds[t], 0, __ATOMIC_RELAXED);
+    // A memoria ainda alocada continua contando; o pico recomeca dela
+    __atomic_store_n(&peak_bytes, __atomic_load_n(&tracked_bytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+void stats_add(StatCounter counter, long long amount){
+    __atomic_fetch_add(&counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+double stats_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void stats_add_time(StatTimer timer, double seconds){
+    __atomic_fetch_add(&timer_nanoseconds[timer], (long long)(seconds * 1e9), __ATOMIC_RELAXED);
+}
+
+void stats_track_memory(long long bytes){
+    long long current = __atomic_add_fetch(&tracked_bytes, bytes, __ATOMIC_RELAXED);
+    long long peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+    while(current > peak && !__atomic_compare_exchange_n(&peak_bytes, &peak, current, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void stats_print(FILE* out, const char* run){
+    fprintf(out, "{\"run\": \"");
+    for(const char* c = run; *c; c++){
+        if(*c == '"' || *c == '\\') fputc('\\', out);
+        if((unsigned char)*c >= ' ') fputc(*c, out);
+    }
+
+    fprintf(out, "\", \"distance_kernel\": \"%s\", \"counters\": {", distance_kernel_name());
+    for(int c = 0; c < STAT_COUNTER_COUNT; c++)
+        fprintf(out, "%s\"%s\": %lld", c ? ", " : "", counter_names[c], __atomic_load_n(&counters[c], __ATOMIC_RELAXED));
+
+    fprintf(out, "}, \"seconds\": {");
+    for(int t = 0; t < STAT_TIMER_COUNT; t++)
+        fprintf(out, "%s\"%s\": %.6f", t ? ", " : "", timer_names[t],
+                __atomic_load_n(&timer_nanoseconds[t], __ATOMIC_RELAXED) * 1e-9);
+
+    fprintf(out, "}, \"tracked_bytes\": {\"current\": %lld, \"peak\": %lld}}\n",
+            __atomic_load_n(&tracked_bytes, __ATOMIC_RELAXED), __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED));
+    fflush(out);
+}
+
+#endif // CCLUSTERING_STATS
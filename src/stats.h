@@ -0,0 +1,79 @@
+/* date = October 17th 2026 8:40 pm */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+// Instrumentacao dos algoritmos: contadores, cronometros de fase e memoria dos buffers
+// grandes (matriz de distancias, limites do k-medias, copias de rotulos). So existe com
+// -DCCLUSTERING_STATS; sem a flag as macros abaixo nao geram codigo nenhum.
+// Os totais sao do processo inteiro: as threads somam com operacoes atomicas, uma vez por
+// bloco de trabalho, e o tempo de fases que rodam em paralelo (reinicios) e somado.
+
+typedef enum {
+    STAT_DISTANCES = 0, // distancias calculadas (ponto-centroide, ponto-ponto, entre centroides)
+    STAT_KMEANS_RUNS,
+    STAT_KMEANS_ITERATIONS,
+    STAT_KMEANS_LIMIT_HITS, // execucoes cortadas pelo iteration_limit antes de convergir
+    STAT_MOVED_POINTS,
+    STAT_MINI_BATCHES,
+    STAT_MERGES, // juncoes do HAC
+    STAT_MATRIX_UPDATES, // atualizacoes de Lance-Williams na matriz condensada
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+typedef enum {
+    TIMER_KMEANS_SEEDING = 0, // centroides e rotulos iniciais
+    TIMER_KMEANS_ITERATIONS,
+    TIMER_MINI_BATCH,
+    TIMER_HAC_MATRIX,
+    TIMER_HAC_MERGE, // laco de juncoes (no single-link, a arvore geradora inteira)
+    TIMER_CUT,
+    TIMER_EVALUATION,
+    TIMER_WRITE_CLU,
+    STAT_TIMER_COUNT
+} StatTimer;
+
+#ifdef CCLUSTERING_STATS
+
+void stats_reset(void);
+
+void stats_add(StatCounter counter, long long amount);
+
+double stats_now(void);
+
+void stats_add_time(StatTimer timer, double seconds);
+
+// bytes > 0 aloca, bytes < 0 libera; guarda o total atual e o pico
+void stats_track_memory(long long bytes);
+
+// Uma linha JSON com o nome da execucao, o kernel de distancia, os contadores, os segundos
+// de cada fase e a memoria
+void stats_print(FILE* out, const char* run);
+
+#define STATS_ONLY(...) __VA_ARGS__
+#define STATS_ADD(counter, amount) stats_add((counter), (amount))
+#define STATS_TIMER_BEGIN(name) double name = stats_now()
+#define STATS_TIMER_END(timer, name) stats_add_time((timer), stats_now() - (name))
+#define STATS_ADD_TIME(timer, seconds) stats_add_time((timer), (seconds))
+#define STATS_ALLOC(bytes) stats_track_memory((long long)(bytes))
+#define STATS_FREE(bytes) stats_track_memory(-(long long)(bytes))
+#define STATS_RESET() stats_reset()
+#define STATS_PRINT(out, run) stats_print((out), (run))
+
+#else
+
+#define STATS_ONLY(...)
+#define STATS_ADD(counter, amount) ((void)0)
+#define STATS_TIMER_BEGIN(name) ((void)0)
+#define STATS_TIMER_END(timer, name) ((void)0)
+#define STATS_ADD_TIME(timer, seconds) ((void)0)
+#define STATS_ALLOC(bytes) ((void)0)
+#define STATS_FREE(bytes) ((void)0)
+#define STATS_RESET() ((void)0)
+#define STATS_PRINT(out, run) ((void)0)
+
+#endif // CCLUSTERING_STATS
+
+#endif // STATS_H
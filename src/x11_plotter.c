@@ -1,65 +1,236 @@
 // x11_plotter.c
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/select.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include "x11_plotter.h"
 
 #define PADDING 50
 #define POINT_RADIUS 2
+#define POINT_BUDGET (1 << 18) // pontos desenhados por quadro, no maximo
+#define GRID_POINTS_PER_CELL 8
+#define GRID_MAX_SIDE 1024
+#define PICK_RADIUS 6
+#define ZOOM_STEP 1.25
+#define MIN_ZOOM 0.5
+#define MAX_ZOOM 1e6
+#define INITIAL_PALETTE_COLORS 16
+#define MAX_PALETTE_COLORS (1 << 20)
+#define GOLDEN_RATIO_CONJUGATE 0.618033988749895
+#define VIEWER_POLL_MS 16 // intervalo maximo entre duas olhadas nos rotulos publicados
 
-const char* CLUSTER_COLOR_NAMES[NUM_CLUSTER_COLORS] = {
-    "black",
-    "red",
-    "green",
-    "blue",
-    "yellow",
-    "magenta",
-    "cyan",
-    "orange",
-    "brown",
-    "pink",
-    "gray",
-    "LimeGreen",
-    "navy"
-};
-
-static void map_data_to_screen_coords(const DataPoint* p, const DataSet* ds,
-                                      int window_width, int window_height,
-                                      int* screen_x, int* screen_y){
-    double data_range_d1 = ds->max_d1 - ds->min_d1;
-    double data_range_d2 = ds->max_d2 - ds->min_d2;
+// Faixa plotada de cada eixo; faixa vazia vira 1 para nao dividir por zero
+static void data_extent(const DataSet* ds, double* min_d1, double* min_d2, double* range_d1, double* range_d2){
+    // So as duas primeiras coordenadas sao plotadas
+    *min_d1 = ds->min[0];
+    *min_d2 = ds->dims > 1 ? ds->min[1] : 0;
+    *range_d1 = ds->max[0] - *min_d1;
+    *range_d2 = ds->dims > 1 ? ds->max[1] - *min_d2 : 0;
     
-    if(data_range_d1 == 0) data_range_d1 = 1;
-    if(data_range_d2 == 0) data_range_d2 = 1;
+    if(*range_d1 == 0) *range_d1 = 1;
+    if(*range_d2 == 0) *range_d2 = 1;
+}
+
+static void reset_view(X11Context* x_context, const DataSet* ds){
+    double min_d1, min_d2, range_d1, range_d2;
+    data_extent(ds, &min_d1, &min_d2, &range_d1, &range_d2);
+    x_context->zoom = 1;
+    x_context->center_x = min_d1 + range_d1 / 2;
+    x_context->center_y = min_d2 + range_d2 / 2;
+    x_context->projection_valid = false;
+}
+
+// Mesma escala nos dois eixos: com zoom 1 o dataset inteiro cabe na area util da janela,
+// e o centro da vista fica no centro dessa area.
+// Tela: x = offset_x + d1 * scale, y = offset_y - d2 * scale.
+static void compute_projection(X11Context* x_context, const DataSet* ds){
+    double min_d1, min_d2, range_d1, range_d2;
+    data_extent(ds, &min_d1, &min_d2, &range_d1, &range_d2);
     
-    double drawable_width = window_width - 2 * PADDING;
-    double drawable_height = window_height - 2 * PADDING;
+    double drawable_width = x_context->width - 2 * PADDING;
+    double drawable_height = x_context->height - 2 * PADDING;
     
     if(drawable_width <= 0) drawable_width = 1;
     if(drawable_height <= 0) drawable_height = 1;
     
-    double scale;
-    double final_plot_width;
-    double final_plot_height;
-    double offset_x = PADDING;
-    double offset_y = PADDING;
+    double fit_scale = drawable_width / range_d1 < drawable_height / range_d2 ?
+        drawable_width / range_d1 : drawable_height / range_d2;
+    
+    x_context->scale = fit_scale * x_context->zoom;
+    x_context->offset_x = PADDING + drawable_width / 2 - x_context->center_x * x_context->scale;
+    x_context->offset_y = PADDING + drawable_height / 2 + x_context->center_y * x_context->scale;
+}
+
+// Celula da grade que contem a coordenada v, presa aos limites
+static int grid_cell(double v, double min, double size, int cells){
+    double c = floor((v - min) / size);
+    return c < 0 ? 0 : c >= cells ? cells - 1 : (int)c;
+}
+
+// Constroi a grade com uns GRID_POINTS_PER_CELL pontos por celula (ordenacao por contagem)
+static bool build_grid(PointGrid* grid, const DataSet* ds){
+    free(grid->cell_start);
+    free(grid->order);
+    free(grid->x);
+    free(grid->y);
     
-    if(drawable_width / data_range_d1 < drawable_height / data_range_d2){
-        scale = drawable_width / data_range_d1;
-        final_plot_width = drawable_width;
-        final_plot_height = data_range_d2 * scale;
-        offset_y +=(drawable_height - final_plot_height) / 2.0;
-    } else {
-        scale = drawable_height / data_range_d2;
-        final_plot_height = drawable_height;
-        final_plot_width = data_range_d1 * scale;
-        offset_x +=(drawable_width - final_plot_width) / 2.0;
+    int side = (int)sqrt(ds->count / (double)GRID_POINTS_PER_CELL);
+    if(side < 1) side = 1;
+    if(side > GRID_MAX_SIDE) side = GRID_MAX_SIDE;
+    
+    double min_d1, min_d2, range_d1, range_d2;
+    data_extent(ds, &min_d1, &min_d2, &range_d1, &range_d2);
+    grid->cells_x = side;
+    grid->cells_y = ds->dims > 1 ? side : 1;
+    grid->min_x = min_d1;
+    grid->min_y = min_d2;
+    grid->cell_width = range_d1 / grid->cells_x;
+    grid->cell_height = range_d2 / grid->cells_y;
+    
+    int cells = grid->cells_x * grid->cells_y;
+    grid->cell_start = calloc(cells + 1, sizeof(int));
+    int n = ds->count ? ds->count : 1;
+    grid->order = malloc(sizeof(int) * n);
+    grid->x = malloc(sizeof(double) * n);
+    grid->y = malloc(sizeof(double) * n);
+    int* cell_of = malloc(sizeof(int) * n);
+    if(!grid->cell_start || !grid->order || !grid->x || !grid->y || !cell_of){
+        free(grid->cell_start);
+        free(grid->order);
+        free(grid->x);
+        free(grid->y);
+        free(cell_of);
+        grid->cell_start = grid->order = NULL;
+        grid->x = grid->y = NULL;
+        return false;
+    }
+    
+    for(int i = 0; i < ds->count; i++){
+        int cx = grid_cell(ds->columns[0][i], grid->min_x, grid->cell_width, grid->cells_x);
+        int cy = ds->dims > 1 ? grid_cell(ds->columns[1][i], grid->min_y, grid->cell_height, grid->cells_y) : 0;
+        cell_of[i] = cy * grid->cells_x + cx;
+        grid->cell_start[cell_of[i] + 1]++;
+    }
+    for(int c = 0; c < cells; c++) grid->cell_start[c + 1] += grid->cell_start[c];
+    
+    int* next = malloc(sizeof(int) * cells);
+    if(!next){
+        free(cell_of);
+        return false;
+    }
+    memcpy(next, grid->cell_start, sizeof(int) * cells);
+    for(int i = 0; i < ds->count; i++){
+        int j = next[cell_of[i]]++;
+        grid->order[j] = i;
+        grid->x[j] = ds->columns[0][i];
+        grid->y[j] = ds->dims > 1 ? ds->columns[1][i] : 0;
     }
     
-    *screen_x =(int)(offset_x +(p->d1 - ds->min_d1) * scale);
-    *screen_y =(int)(offset_y + final_plot_height -(p->d2 - ds->min_d2) * scale);
+    free(next);
+    free(cell_of);
+    return true;
+}
+
+// Faixa de celulas (inclusive) que cobre o retangulo de tela [x0, x1] x [y0, y1]
+static void screen_rect_cells(const X11Context* x_context, double x0, double y0, double x1, double y1,
+                              int* cx0, int* cy0, int* cx1, int* cy1){
+    const PointGrid* grid = &x_context->grid;
+    double scale = x_context->scale;
+    *cx0 = grid_cell((x0 - x_context->offset_x) / scale, grid->min_x, grid->cell_width, grid->cells_x);
+    *cx1 = grid_cell((x1 - x_context->offset_x) / scale, grid->min_x, grid->cell_width, grid->cells_x);
+    // O eixo y da tela e invertido
+    *cy0 = grid_cell((x_context->offset_y - y1) / scale, grid->min_y, grid->cell_height, grid->cells_y);
+    *cy1 = grid_cell((x_context->offset_y - y0) / scale, grid->min_y, grid->cell_height, grid->cells_y);
+}
+
+// Coordenadas de tela dos pontos das celulas visiveis, numa passada so, guardadas ate a
+// janela mudar de tamanho, a vista mudar ou o dataset mudar. Nivel de detalhe: com mais de
+// POINT_BUDGET pontos visiveis, pega um a cada stride dentro de cada faixa de celulas, o
+// que mantem a amostra espalhada como os dados. Fora do alcance de um short, o ponto fica
+// preso na borda.
+static bool project_points(X11Context* x_context, const DataSet* dataset){
+    if(x_context->indexed != dataset){
+        if(!build_grid(&x_context->grid, dataset)) return false;
+        x_context->indexed = dataset;
+        x_context->palette_warned = false; // outro dataset, outro agrupamento
+        reset_view(x_context, dataset);
+    }
+    if(x_context->projection_valid) return true;
+    
+    compute_projection(x_context, dataset);
+    const PointGrid* grid = &x_context->grid;
+    int cx0, cy0, cx1, cy1;
+    screen_rect_cells(x_context, -POINT_RADIUS, -POINT_RADIUS, x_context->width + POINT_RADIUS,
+                      x_context->height + POINT_RADIUS, &cx0, &cy0, &cx1, &cy1);
+    
+    long long visible = 0;
+    for(int cy = cy0; cy <= cy1; cy++)
+        visible += grid->cell_start[cy * grid->cells_x + cx1 + 1] - grid->cell_start[cy * grid->cells_x + cx0];
+    int stride = (int)((visible + POINT_BUDGET - 1) / POINT_BUDGET);
+    if(stride < 1) stride = 1;
+    
+    int capacity = (int)((visible + stride - 1) / stride) + (cy1 - cy0 + 1);
+    if(x_context->screen_capacity < capacity){
+        free(x_context->screen_points);
+        free(x_context->screen_index);
+        x_context->screen_points = malloc(sizeof(XPoint) * capacity);
+        x_context->screen_index = malloc(sizeof(int) * capacity);
+        x_context->screen_capacity = x_context->screen_points && x_context->screen_index ? capacity : 0;
+        if(!x_context->screen_capacity) return false;
+    }
+    
+    double scale = x_context->scale, offset_x = x_context->offset_x, offset_y = x_context->offset_y;
+    XPoint* screen = x_context->screen_points;
+    int count = 0;
+    for(int cy = cy0; cy <= cy1; cy++){
+        int end = grid->cell_start[cy * grid->cells_x + cx1 + 1];
+        for(int j = grid->cell_start[cy * grid->cells_x + cx0]; j < end; j += stride){
+            double sx = offset_x + grid->x[j] * scale;
+            double sy = offset_y - grid->y[j] * scale;
+            sx = sx < SHRT_MIN ? SHRT_MIN : sx > SHRT_MAX ? SHRT_MAX : sx;
+            sy = sy < SHRT_MIN ? SHRT_MIN : sy > SHRT_MAX ? SHRT_MAX : sy;
+            screen[count].x = (short)sx;
+            screen[count].y = (short)sy;
+            x_context->screen_index[count++] = grid->order[j];
+        }
+    }
+    
+    x_context->visible_count = count;
+    x_context->visible_total = visible;
+    x_context->projection_valid = true;
+    return true;
+}
+
+// Ponto mais proximo do cursor a ate PICK_RADIUS pixels, procurando so nas celulas em
+// volta (todos os pontos, nao so a amostra desenhada). Devolve -1 se nao houver.
+static int pick_point(const X11Context* x_context, const DataSet* dataset, int mouse_x, int mouse_y){
+    if(x_context->indexed != dataset || !x_context->projection_valid) return -1;
+    
+    const PointGrid* grid = &x_context->grid;
+    int cx0, cy0, cx1, cy1;
+    screen_rect_cells(x_context, mouse_x - PICK_RADIUS, mouse_y - PICK_RADIUS, mouse_x + PICK_RADIUS,
+                      mouse_y + PICK_RADIUS, &cx0, &cy0, &cx1, &cy1);
+    
+    int best = -1;
+    double best_distance = (double)PICK_RADIUS * PICK_RADIUS;
+    for(int cy = cy0; cy <= cy1; cy++){
+        int end = grid->cell_start[cy * grid->cells_x + cx1 + 1];
+        for(int j = grid->cell_start[cy * grid->cells_x + cx0]; j < end; j++){
+            double dx = x_context->offset_x + grid->x[j] * x_context->scale - mouse_x;
+            double dy = x_context->offset_y - grid->y[j] * x_context->scale - mouse_y;
+            if(dx * dx + dy * dy <= best_distance){
+                best_distance = dx * dx + dy * dy;
+                best = grid->order[j];
+            }
+        }
+    }
+    return best;
 }
 
 X11Context* init_x11(const char* window_title, int width, int height){
@@ -92,9 +263,12 @@ X11Context* init_x11(const char* window_title, int width, int height){
     
     context->gc = XCreateGC(context->display, context->window, 0, NULL);
     XSetBackground(context->display, context->gc, context->white_pixel);
+    // A copia do quadro para a janela nao precisa gerar eventos de exposicao
+    XSetGraphicsExposures(context->display, context->gc, False);
     XSetForeground(context->display, context->gc, context->black_pixel);
     
-    XSelectInput(context->display, context->window, ExposureMask | KeyPressMask | StructureNotifyMask);
+    XSelectInput(context->display, context->window, ExposureMask | KeyPressMask | StructureNotifyMask |
+                 ButtonPressMask | ButtonReleaseMask | PointerMotionMask);
     
     XMapWindow(context->display, context->window);
     
@@ -106,121 +280,559 @@ X11Context* init_x11(const char* window_title, int width, int height){
     context->width = width;
     context->height = height;
     
+    context->frame = None;
+    context->frame_width = context->frame_height = 0;
+    context->frame_valid = false;
+    context->palette = NULL;
+    context->palette_size = 0;
+    context->color_offsets = NULL;
+    context->color_next = NULL;
+    context->palette_checked = NULL;
+    context->palette_warned = false;
+    context->point_colors = NULL;
+    context->rectangles = NULL;
+    context->point_capacity = 0;
+    context->bin_color = NULL;
+    context->bin_votes = NULL;
+    context->bin_points = NULL;
+    context->bin_capacity = 0;
+    memset(&context->grid, 0, sizeof(context->grid));
+    context->indexed = NULL;
+    context->zoom = 1;
+    context->center_x = context->center_y = 0;
+    context->screen_points = NULL;
+    context->screen_index = NULL;
+    context->screen_capacity = 0;
+    context->visible_count = 0;
+    context->visible_total = 0;
+    context->projection_valid = false;
+    context->dragging = false;
+    context->drag_x = context->drag_y = 0;
+    context->picked = -1;
+    context->step = 0;
+    
     return context;
 }
 
-void draw_points_on_expose(X11Context* x_context, const DataSet* dataset, double ari){
-    if(!x_context || !dataset || !dataset->count) return;
+// Componente (0 a 1) escalada para a mascara do canal num visual TrueColor
+static unsigned long channel_pixel(unsigned long mask, double value){
+    if(!mask) return 0;
+    int shift = 0, bits = 0;
+    while(!((mask >> shift) & 1)) shift++;
+    while((mask >> (shift + bits)) & 1) bits++;
+    unsigned long level = (unsigned long)(value * ((1UL << bits) - 1) + 0.5);
+    return level << shift;
+}
+
+static void hsv_to_rgb(double h, double s, double v, double* r, double* g, double* b){
+    double sector = h * 6;
+    int i = (int)sector % 6;
+    double f = sector - floor(sector);
+    double p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+    switch(i){
+        case 0: *r = v; *g = t; *b = p; break;
+        case 1: *r = q; *g = v; *b = p; break;
+        case 2: *r = p; *g = v; *b = t; break;
+        case 3: *r = p; *g = q; *b = v; break;
+        case 4: *r = t; *g = p; *b = v; break;
+        default: *r = v; *g = p; *b = q; break;
+    }
+}
+
+// Cor do cluster c: matizes espalhados pela razao aurea (clusters vizinhos ficam bem
+// diferentes), e a cada volta de 12 cores muda a saturacao ou o brilho
+static unsigned long cluster_pixel(X11Context* x_context, int c){
+    int band = c / 12;
+    double r, g, b;
+    hsv_to_rgb(fmod(c * GOLDEN_RATIO_CONJUGATE, 1.0), band % 2 ? 0.55 : 0.9, (band / 2) % 2 ? 0.65 : 0.9, &r, &g, &b);
     
-    XSetForeground(x_context->display, x_context->gc, x_context->white_pixel);
-    XFillRectangle(x_context->display, x_context->window, x_context->gc, 0, 0, x_context->width, x_context->height);
+    // So no TrueColor o pixel e a propria cor; no DirectColor ele ainda passa por uma
+    // tabela de cores gravavel, entao vai pelo XAllocColor como os demais
+    Visual* visual = DefaultVisual(x_context->display, x_context->screen);
+    if(visual->class == TrueColor)
+        return channel_pixel(visual->red_mask, r) | channel_pixel(visual->green_mask, g) | channel_pixel(visual->blue_mask, b);
+    
+    // Visual com tabela de cores: uma ida ao servidor por cor, so quando a cor entra na
+    // paleta (ensure_palette nunca gera de novo uma cor que ja existe)
+    XColor color;
+    color.red = (unsigned short)(r * 65535);
+    color.green = (unsigned short)(g * 65535);
+    color.blue = (unsigned short)(b * 65535);
+    color.flags = DoRed | DoGreen | DoBlue;
+    if(XAllocColor(x_context->display, DefaultColormap(x_context->display, x_context->screen), &color)) return color.pixel;
+    return x_context->black_pixel;
+}
+
+// Garante cores para os ids 0 .. size - 2; so gera as que ainda nao existem
+static bool ensure_palette(X11Context* x_context, int size){
+    if(x_context->palette_size >= size) return true;
+    
+    unsigned long* palette = realloc(x_context->palette, sizeof(unsigned long) * size);
+    if(!palette) return false;
+    x_context->palette = palette;
     
+    free(x_context->color_offsets);
+    free(x_context->color_next);
+    x_context->color_offsets = malloc(sizeof(int) * (size + 1));
+    x_context->color_next = malloc(sizeof(int) * size);
+    if(!x_context->color_offsets || !x_context->color_next){
+        free(x_context->color_offsets);
+        free(x_context->color_next);
+        x_context->color_offsets = x_context->color_next = NULL;
+        x_context->palette_size = 0;
+        return false;
+    }
+    
+    if(!x_context->palette_size) palette[x_context->palette_size++] = x_context->black_pixel;
+    while(x_context->palette_size < size){
+        palette[x_context->palette_size] = cluster_pixel(x_context, x_context->palette_size - 1);
+        x_context->palette_size++;
+    }
+    return true;
+}
+
+// Uma passada pelos ids quando os rotulos mudam: a paleta cresce ate o maior id, e os ids
+// grandes demais geram um aviso so por agrupamento (nao a cada rotulo publicado pelo
+// visualizador ao vivo), com a quantidade de pontos. Id negativo e ponto sem
+// cluster (ainda sem rotulo, ou sozinho no meio do HAC): fica preto, sem aviso.
+static bool prepare_palette(X11Context* x_context, const DataSet* dataset){
+    if(x_context->palette_checked == dataset && x_context->palette_size) return true;
+    
+    int max_id = -1;
+    long long invalid = 0;
     for(int i = 0; i < dataset->count; i++){
-        int sx, sy;
-        map_data_to_screen_coords(&dataset->points[i], dataset,
-                                  x_context->width, x_context->height, &sx, &sy);
-        
-        int cluster_id = dataset->points[i].cluster_id;
-        unsigned long current_point_color_pixel;
+        int id = dataset->cluster_id[i];
+        if(id >= MAX_PALETTE_COLORS - 1) invalid++;
+        else if(id > max_id) max_id = id;
+    }
+    if(invalid && !x_context->palette_warned){
+        x_context->palette_warned = true;
+        fprintf(stderr, "Aviso: %lld pontos com cluster_id acima de %d. Usando preto.\n",
+                invalid, MAX_PALETTE_COLORS - 2);
+    }
+    
+    if(!ensure_palette(x_context, max_id + 2)) return false;
+    x_context->palette_checked = dataset;
+    return true;
+}
+
+// Indice da cor na paleta; fora dela fica preto (ja avisado em prepare_palette)
+static int point_color(const X11Context* x_context, int cluster_id){
+    return cluster_id >= 0 && cluster_id + 1 < x_context->palette_size ? cluster_id + 1 : 0;
+}
+
+static bool ensure_point_buffers(X11Context* x_context, int count){
+    if(x_context->point_capacity >= count) return true;
+    free(x_context->point_colors);
+    free(x_context->rectangles);
+    x_context->point_colors = malloc(sizeof(int) * count);
+    x_context->rectangles = malloc(sizeof(XRectangle) * count);
+    x_context->point_capacity = x_context->point_colors && x_context->rectangles ? count : 0;
+    return x_context->point_capacity > 0;
+}
+
+static bool ensure_bin_buffers(X11Context* x_context, int bins){
+    if(x_context->bin_capacity >= bins) return true;
+    free(x_context->bin_color);
+    free(x_context->bin_votes);
+    free(x_context->bin_points);
+    x_context->bin_color = malloc(sizeof(int) * bins);
+    x_context->bin_votes = malloc(sizeof(int) * bins);
+    x_context->bin_points = malloc(sizeof(XPoint) * bins);
+    x_context->bin_capacity = x_context->bin_color && x_context->bin_votes && x_context->bin_points ? bins : 0;
+    return x_context->bin_capacity > 0;
+}
+
+// Um ponto por retangulo, agrupados por cor: uma chamada XFillRectangles por cor
+static void draw_point_batches(X11Context* x_context, const DataSet* dataset, Drawable target){
+    int count = x_context->visible_count;
+    if(!ensure_point_buffers(x_context, count)) return;
+    
+    int colors = x_context->palette_size;
+    int* offsets = x_context->color_offsets;
+    int* next = x_context->color_next;
+    memset(offsets, 0, sizeof(int) * (colors + 1));
+    for(int i = 0; i < count; i++){
+        x_context->point_colors[i] = point_color(x_context, dataset->cluster_id[x_context->screen_index[i]]);
+        offsets[x_context->point_colors[i] + 1]++;
+    }
+    for(int c = 0; c < colors; c++) offsets[c + 1] += offsets[c];
+    
+    memcpy(next, offsets, sizeof(int) * colors);
+    const XPoint* screen = x_context->screen_points;
+    for(int i = 0; i < count; i++){
+        XRectangle* rectangle = &x_context->rectangles[next[x_context->point_colors[i]]++];
+        rectangle->x = (short)(screen[i].x - POINT_RADIUS);
+        rectangle->y = (short)(screen[i].y - POINT_RADIUS);
+        rectangle->width = rectangle->height = 2 * POINT_RADIUS;
+    }
+    
+    for(int c = 0; c < colors; c++){
+        if(offsets[c + 1] == offsets[c]) continue;
+        XSetForeground(x_context->display, x_context->gc, x_context->palette[c]);
+        XFillRectangles(x_context->display, target, x_context->gc,
+                        x_context->rectangles + offsets[c], offsets[c + 1] - offsets[c]);
+    }
+}
+
+// Mais pontos que pixels: cada pixel mostra a cor da maioria dos pontos que caem nele
+// (voto de Boyer-Moore, sem contar por cluster) e o X recebe um ponto por pixel ocupado.
+static void draw_density_bins(X11Context* x_context, const DataSet* dataset, Drawable target){
+    int width = x_context->width, height = x_context->height;
+    int bins = width * height;
+    if(!ensure_bin_buffers(x_context, bins)) return;
+    
+    for(int b = 0; b < bins; b++){
+        x_context->bin_color[b] = -1;
+        x_context->bin_votes[b] = 0;
+    }
+    
+    const XPoint* screen = x_context->screen_points;
+    for(int i = 0; i < x_context->visible_count; i++){
+        int sx = screen[i].x, sy = screen[i].y;
+        if(sx < 0 || sy < 0 || sx >= width || sy >= height) continue;
         
-        if(cluster_id >= 0 && cluster_id < NUM_CLUSTER_COLORS){
-            current_point_color_pixel = x_context->cluster_color_pixels[cluster_id + 1];
-        } else{
-            fprintf(stderr, "Aviso: cluster_id %d para o ponto %d está fora do intervalo [0, %d). Usando preto.\n",
-                    cluster_id, i, NUM_CLUSTER_COLORS);
-            current_point_color_pixel = x_context->cluster_color_pixels[CLUSTER_COLOR_BLACK];
+        int b = sy * width + sx;
+        int color = point_color(x_context, dataset->cluster_id[x_context->screen_index[i]]);
+        if(x_context->bin_color[b] == color) x_context->bin_votes[b]++;
+        else if(x_context->bin_votes[b] > 0) x_context->bin_votes[b]--;
+        else {
+            x_context->bin_color[b] = color;
+            x_context->bin_votes[b] = 1;
         }
-        
-        XSetForeground(x_context->display, x_context->gc, current_point_color_pixel);
-        XFillArc(x_context->display, x_context->window, x_context->gc,
-                 sx - POINT_RADIUS, sy - POINT_RADIUS,
-                 2 * POINT_RADIUS, 2 * POINT_RADIUS,
-                 0, 360 * 64);
     }
+    
+    int colors = x_context->palette_size;
+    int* offsets = x_context->color_offsets;
+    int* next = x_context->color_next;
+    memset(offsets, 0, sizeof(int) * (colors + 1));
+    for(int b = 0; b < bins; b++)
+        if(x_context->bin_color[b] >= 0) offsets[x_context->bin_color[b] + 1]++;
+    for(int c = 0; c < colors; c++) offsets[c + 1] += offsets[c];
+    
+    memcpy(next, offsets, sizeof(int) * colors);
+    for(int b = 0; b < bins; b++){
+        if(x_context->bin_color[b] < 0) continue;
+        XPoint* point = &x_context->bin_points[next[x_context->bin_color[b]]++];
+        point->x = (short)(b % width);
+        point->y = (short)(b / width);
+    }
+    
+    for(int c = 0; c < colors; c++){
+        if(offsets[c + 1] == offsets[c]) continue;
+        XSetForeground(x_context->display, x_context->gc, x_context->palette[c]);
+        XDrawPoints(x_context->display, target, x_context->gc, x_context->bin_points + offsets[c],
+                    offsets[c + 1] - offsets[c], CoordModeOrigin);
+    }
+}
 
+// Redesenha o quadro inteiro no pixmap (recriado se a janela mudou de tamanho)
+static void render_frame(X11Context* x_context, const DataSet* dataset, double ari){
+    if(!x_context->frame || x_context->frame_width != x_context->width || x_context->frame_height != x_context->height){
+        if(x_context->frame) XFreePixmap(x_context->display, x_context->frame);
+        x_context->frame = XCreatePixmap(x_context->display, x_context->window, x_context->width, x_context->height,
+                                         DefaultDepth(x_context->display, x_context->screen));
+        x_context->frame_width = x_context->width;
+        x_context->frame_height = x_context->height;
+    }
+    Drawable target = x_context->frame;
+    
+    XSetForeground(x_context->display, x_context->gc, x_context->white_pixel);
+    XFillRectangle(x_context->display, target, x_context->gc, 0, 0, x_context->width, x_context->height);
+    
+    // Nivel de detalhe: com mais pontos visiveis que pixels na area do grafico (contando os
+    // que a amostra deixou de fora), agrega por pixel
+    if(!project_points(x_context, dataset) || !prepare_palette(x_context, dataset)) return;
+    long long plot_pixels = (long long)(x_context->width - 2 * PADDING) * (x_context->height - 2 * PADDING);
+    if(x_context->visible_total > plot_pixels) draw_density_bins(x_context, dataset, target);
+    else draw_point_batches(x_context, dataset, target);
+    
+    // Sem ARI (NAN) o algoritmo ainda esta rodando: mostra a etapa
     char ari_string[64];
-    snprintf(ari_string, sizeof(ari_string), "Adjusted Rand Index: %.4f", ari);
+    if(isnan(ari)) snprintf(ari_string, sizeof(ari_string), "Executando... etapa %d", x_context->step);
+    else snprintf(ari_string, sizeof(ari_string), "Adjusted Rand Index: %.4f", ari);
     XSetForeground(x_context->display, x_context->gc, x_context->black_pixel);
-    XDrawString(x_context->display, x_context->window, x_context->gc, 10, x_context->height - 10, ari_string, strlen(ari_string));
+    XDrawString(x_context->display, target, x_context->gc, 10, x_context->height - 10, ari_string, strlen(ari_string));
+    
+    x_context->frame_valid = true;
+}
+
+void invalidate_frame(X11Context* x_context){
+    if(!x_context) return;
+    x_context->frame_valid = false;
+    x_context->palette_checked = NULL;
+}
 
+void draw_points_on_expose(X11Context* x_context, const DataSet* dataset, double ari){
+    if(!x_context || !dataset || !dataset->count) return;
+    
+    if(!x_context->frame_valid) render_frame(x_context, dataset, ari);
+    XCopyArea(x_context->display, x_context->frame, x_context->window, x_context->gc,
+              0, 0, x_context->width, x_context->height, 0, 0);
+    
+    int picked = x_context->picked;
+    if(picked >= 0 && picked < dataset->count && x_context->projection_valid){
+        int sx = (int)(x_context->offset_x + dataset->columns[0][picked] * x_context->scale);
+        int sy = (int)(x_context->offset_y - (dataset->dims > 1 ? dataset->columns[1][picked] : 0) * x_context->scale);
+        char info[128];
+        snprintf(info, sizeof(info), "%s (cluster %d)", dataset_label(dataset, picked), dataset->cluster_id[picked]);
+        XSetForeground(x_context->display, x_context->gc, x_context->black_pixel);
+        XDrawRectangle(x_context->display, x_context->window, x_context->gc,
+                       sx - POINT_RADIUS - 2, sy - POINT_RADIUS - 2, 2 * POINT_RADIUS + 4, 2 * POINT_RADIUS + 4);
+        XDrawString(x_context->display, x_context->window, x_context->gc, 10, 20, info, strlen(info));
+    }
     XFlush(x_context->display);
 }
 
-void run_x11_event_loop(X11Context* x_context, const DataSet* dataset, double ari){
-    XEvent event;
+// Aproxima (factor > 1) ou afasta mantendo parado o ponto dos dados sob (screen_x, screen_y)
+static void zoom_view(X11Context* x_context, const DataSet* dataset, double factor, int screen_x, int screen_y){
+    compute_projection(x_context, dataset);
+    double zoom = x_context->zoom * factor;
+    if(zoom < MIN_ZOOM) zoom = MIN_ZOOM;
+    if(zoom > MAX_ZOOM) zoom = MAX_ZOOM;
+    if(zoom == x_context->zoom) return;
+    
+    double data_x = (screen_x - x_context->offset_x) / x_context->scale;
+    double data_y = (x_context->offset_y - screen_y) / x_context->scale;
+    double new_scale = x_context->scale * zoom / x_context->zoom;
+    double plot_center_x = PADDING + (x_context->width - 2 * PADDING) / 2.0;
+    double plot_center_y = PADDING + (x_context->height - 2 * PADDING) / 2.0;
+    x_context->zoom = zoom;
+    x_context->center_x = data_x - (screen_x - plot_center_x) / new_scale;
+    x_context->center_y = data_y + (screen_y - plot_center_y) / new_scale;
+    x_context->projection_valid = false;
+    x_context->frame_valid = false;
+}
+
+// Move a vista em pixels (positivo leva o conteudo para a direita/baixo)
+static void pan_view(X11Context* x_context, const DataSet* dataset, int dx, int dy){
+    compute_projection(x_context, dataset);
+    x_context->center_x -= dx / x_context->scale;
+    x_context->center_y += dy / x_context->scale;
+    x_context->projection_valid = false;
+    x_context->frame_valid = false;
+}
+
+// Trata um evento da janela; devolve false quando o usuario pede para sair
+static bool handle_event(X11Context* x_context, const DataSet* dataset, double ari, XEvent* event){
     KeySym key;
     char buffer[10];
     
-    while(1){
-        XNextEvent(x_context->display, &event);
+    switch(event->type){
+        case Expose:
+        if(!event->xexpose.count){
+            draw_points_on_expose(x_context, dataset, ari);
+        }
+        break;
         
-        switch(event.type){
-            case Expose:
-            if(!event.xexpose.count){
+        case KeyPress:
+        XLookupString(&event->xkey, buffer, sizeof(buffer), &key, NULL);
+        if(key == XK_q || key == XK_Q){
+            return false;
+        }
+        if(key == XK_plus || key == XK_equal || key == XK_KP_Add){
+            zoom_view(x_context, dataset, ZOOM_STEP, x_context->width / 2, x_context->height / 2);
+        } else if(key == XK_minus || key == XK_KP_Subtract){
+            zoom_view(x_context, dataset, 1 / ZOOM_STEP, x_context->width / 2, x_context->height / 2);
+        } else if(key == XK_Left || key == XK_Right){
+            pan_view(x_context, dataset, (key == XK_Left ? 1 : -1) * x_context->width / 10, 0);
+        } else if(key == XK_Up || key == XK_Down){
+            pan_view(x_context, dataset, 0, (key == XK_Up ? 1 : -1) * x_context->height / 10);
+        } else if(key == XK_0 || key == XK_r || key == XK_R){
+            reset_view(x_context, dataset);
+            x_context->frame_valid = false;
+        } else break;
+        x_context->picked = -1;
+        draw_points_on_expose(x_context, dataset, ari);
+        break;
+        
+        case ButtonPress:
+        if(event->xbutton.button == Button4 || event->xbutton.button == Button5){
+            zoom_view(x_context, dataset, event->xbutton.button == Button4 ? ZOOM_STEP : 1 / ZOOM_STEP,
+                      event->xbutton.x, event->xbutton.y);
+            x_context->picked = -1;
+            draw_points_on_expose(x_context, dataset, ari);
+        } else if(event->xbutton.button == Button1){
+            x_context->dragging = true;
+            x_context->drag_x = event->xbutton.x;
+            x_context->drag_y = event->xbutton.y;
+        }
+        break;
+        
+        case ButtonRelease:
+        if(event->xbutton.button == Button1) x_context->dragging = false;
+        break;
+        
+        case MotionNotify:
+        {
+            // So o ultimo movimento da fila importa
+            while(XCheckTypedWindowEvent(x_context->display, x_context->window, MotionNotify, event));
+            int mx = event->xmotion.x, my = event->xmotion.y;
+            if(x_context->dragging){
+                pan_view(x_context, dataset, mx - x_context->drag_x, my - x_context->drag_y);
+                x_context->drag_x = mx;
+                x_context->drag_y = my;
+                x_context->picked = -1;
                 draw_points_on_expose(x_context, dataset, ari);
-            }
-            break;
-            
-            case KeyPress:
-            XLookupString(&event.xkey, buffer, sizeof(buffer), &key, NULL);
-            if(key == XK_q || key == XK_Q){
-                return;
-            }
-            break;
-            
-            case ConfigureNotify:
-            {
-                XConfigureEvent xce = event.xconfigure;
-                if(xce.width != x_context->width || xce.height != x_context->height){
-                    x_context->width = xce.width;
-                    x_context->height = xce.height;
+            } else {
+                int picked = pick_point(x_context, dataset, mx, my);
+                if(picked != x_context->picked){
+                    x_context->picked = picked;
+                    draw_points_on_expose(x_context, dataset, ari);
                 }
             }
-            break;
-            
-            case ClientMessage:
-            {
-                Atom wm_delete_window = XInternAtom(x_context->display, "WM_DELETE_WINDOW", False);
-                if(event.xclient.message_type == XInternAtom(x_context->display, "WM_PROTOCOLS", False) &&
-                   (Atom)event.xclient.data.l[0] == wm_delete_window){
-                    return;
-                }
+        }
+        break;
+        
+        case ConfigureNotify:
+        {
+            XConfigureEvent xce = event->xconfigure;
+            if(xce.width != x_context->width || xce.height != x_context->height){
+                x_context->width = xce.width;
+                x_context->height = xce.height;
+                x_context->projection_valid = false;
+                x_context->frame_valid = false;
             }
-            break;
-            
-            default:
-            break;
         }
+        break;
+        
+        case ClientMessage:
+        {
+            Atom wm_delete_window = XInternAtom(x_context->display, "WM_DELETE_WINDOW", False);
+            if(event->xclient.message_type == XInternAtom(x_context->display, "WM_PROTOCOLS", False) &&
+               (Atom)event->xclient.data.l[0] == wm_delete_window){
+                return false;
+            }
+        }
+        break;
+        
+        default:
+        break;
+    }
+    return true;
+}
+
+void run_x11_event_loop(X11Context* x_context, const DataSet* dataset, double ari){
+    XEvent event;
+    do{
+        XNextEvent(x_context->display, &event);
+    } while(handle_event(x_context, dataset, ari, &event));
+}
+
+struct X11Viewer {
+    X11Context* context;
+    DataSet view; // copia rasa do dataset, com cluster_id apontando para a copia lida
+    LabelBuffer* labels;
+    pthread_t thread;
+    int closed; // so por operacoes atomicas
+};
+
+static void* viewer_thread(void* argument){
+    X11Viewer* viewer = (X11Viewer*)argument;
+    X11Context* x_context = viewer->context;
+    int connection = ConnectionNumber(x_context->display);
+    double ari = NAN;
+    bool running = true;
+    
+    while(running){
+        bool fresh;
+        const LabelSnapshot* snapshot = acquire_labels(viewer->labels, &fresh);
+        if(fresh){
+            viewer->view.cluster_id = snapshot->cluster_id;
+            x_context->step = snapshot->step;
+            ari = snapshot->score;
+            invalidate_frame(x_context);
+            draw_points_on_expose(x_context, &viewer->view, ari);
+        }
+        
+        while(running && XPending(x_context->display)){
+            XEvent event;
+            XNextEvent(x_context->display, &event);
+            running = handle_event(x_context, &viewer->view, ari, &event);
+        }
+        if(!running) break;
+        
+        // Dorme ate chegar um evento ou ate a hora de olhar os rotulos de novo
+        fd_set connections;
+        FD_ZERO(&connections);
+        FD_SET(connection, &connections);
+        struct timeval timeout = {0, VIEWER_POLL_MS * 1000};
+        select(connection + 1, &connections, NULL, NULL, &timeout);
     }
+    
+    __atomic_store_n(&viewer->closed, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+X11Viewer* start_x11_viewer(const char* window_title, int width, int height, const DataSet* dataset){
+    X11Viewer* viewer = malloc(sizeof(X11Viewer));
+    if(!viewer) return NULL;
+    
+    viewer->labels = create_label_buffer(dataset->count);
+    viewer->context = viewer->labels ? init_x11(window_title, width, height) : NULL;
+    if(!viewer->context){
+        free_label_buffer(viewer->labels);
+        free(viewer);
+        return NULL;
+    }
+    initialize_cluster_colors(viewer->context);
+    
+    bool fresh;
+    viewer->view = *dataset;
+    viewer->view.cluster_id = acquire_labels(viewer->labels, &fresh)->cluster_id;
+    viewer->closed = 0;
+    
+    // Daqui em diante o display e so da thread do visualizador
+    if(pthread_create(&viewer->thread, NULL, viewer_thread, viewer)){
+        close_x11(viewer->context);
+        free_label_buffer(viewer->labels);
+        free(viewer);
+        return NULL;
+    }
+    return viewer;
+}
+
+void publish_to_viewer(X11Viewer* viewer, const int* cluster_id, int step, double ari){
+    if(viewer) publish_labels(viewer->labels, cluster_id, step, ari);
+}
+
+bool x11_viewer_closed(X11Viewer* viewer){
+    return viewer && __atomic_load_n(&viewer->closed, __ATOMIC_ACQUIRE);
+}
+
+void join_x11_viewer(X11Viewer* viewer){
+    if(!viewer) return;
+    pthread_join(viewer->thread, NULL);
+    close_x11(viewer->context);
+    free_label_buffer(viewer->labels);
+    free(viewer);
 }
 
 void close_x11(X11Context* x_context){
     if(!x_context) return;
     
+    if(x_context->frame) XFreePixmap(x_context->display, x_context->frame);
     if(x_context->gc) XFreeGC(x_context->display, x_context->gc);
+    free(x_context->point_colors);
+    free(x_context->rectangles);
+    free(x_context->bin_color);
+    free(x_context->bin_votes);
+    free(x_context->bin_points);
+    free(x_context->screen_points);
+    free(x_context->screen_index);
+    free(x_context->grid.cell_start);
+    free(x_context->grid.order);
+    free(x_context->grid.x);
+    free(x_context->grid.y);
+    free(x_context->palette);
+    free(x_context->color_offsets);
+    free(x_context->color_next);
     if(x_context->display) XCloseDisplay(x_context->display);
     free(x_context);
 }
 
 void initialize_cluster_colors(X11Context* x_context){
     if(!x_context || !x_context->display) return;
-    
-    Colormap colormap = DefaultColormap(x_context->display, DefaultScreen(x_context->display));
-    XColor screen_color, exact_color;
-    
-    for(int i = 0; i < NUM_CLUSTER_COLORS; i++){
-        if(XAllocNamedColor(x_context->display, colormap, CLUSTER_COLOR_NAMES[i], &screen_color, &exact_color)){
-            x_context->cluster_color_pixels[i] = screen_color.pixel;
-        } else{
-            fprintf(stderr, "Aviso: Não foi possível alocar a cor '%s'. Usando preto.\n", CLUSTER_COLOR_NAMES[i]);
-            if(i == CLUSTER_COLOR_BLACK && x_context->black_pixel){
-                x_context->cluster_color_pixels[i] = x_context->black_pixel;
-            } else if(x_context->black_pixel){
-                x_context->cluster_color_pixels[i] = x_context->black_pixel;
-            } else{
-                x_context->cluster_color_pixels[i] = WhitePixel(x_context->display, DefaultScreen(x_context->display));
-                fprintf(stderr, "Erro crítico: black_pixel não inicializado e falha ao alocar %s. Usando branco.\n", CLUSTER_COLOR_NAMES[i]);
-            }
-        }
-    }
+    if(!ensure_palette(x_context, INITIAL_PALETTE_COLORS))
+        fprintf(stderr, "Aviso: Não foi possível alocar a paleta de cores.\n");
 }
@@ -3,9 +3,24 @@
 #define X11_PLOTTER_H
 
 #include "data_loader.h"
+#include "label_buffer.h"
 #include <X11/Xlib.h>
 
-#define NUM_CLUSTER_COLORS 13
+// Grade uniforme sobre as duas primeiras coordenadas, com os indices dos pontos ordenados
+// por celula: as celulas de uma linha da grade ficam contiguas em order. As coordenadas
+// sao copiadas na mesma ordem, para a projecao ler a memoria em sequencia.
+typedef struct {
+    int cells_x;
+    int cells_y;
+    double min_x;
+    double min_y;
+    double cell_width;
+    double cell_height;
+    int* cell_start; // cells_x * cells_y + 1 posicoes em order
+    int* order;
+    double* x; // x[j] e y[j] sao as coordenadas do ponto order[j]
+    double* y;
+} PointGrid;
 
 typedef struct {
     Display *display;
@@ -14,35 +29,99 @@ typedef struct {
     int screen;
     unsigned long black_pixel;
     unsigned long white_pixel;
-    unsigned long cluster_color_pixels[NUM_CLUSTER_COLORS];
+    
+    // Paleta gerada: palette[0] e preto (cluster_id invalido), palette[c + 1] e a cor do
+    // cluster c. Cresce ate o maior cluster_id do agrupamento mostrado.
+    unsigned long* palette;
+    int palette_size;
+    int* color_offsets; // ordenacao por cor dos pontos/pixels: palette_size + 1 posicoes
+    int* color_next;
+    const DataSet* palette_checked; // agrupamento cujos ids ja foram checados contra a paleta
+    bool palette_warned; // ids grandes demais ja avisados neste agrupamento (nao a cada rotulo publicado)
     int width;
     int height;
+    
+    // Quadro desenhado fora da tela: o Expose so copia, e so se redesenha quando o
+    // tamanho da janela (ou os dados) mudam
+    Pixmap frame;
+    int frame_width;
+    int frame_height;
+    bool frame_valid;
+    
+    // Buffers do desenho em lote, reaproveitados entre quadros
+    int* point_colors; // indice da cor de cada ponto
+    XRectangle* rectangles; // pontos agrupados por cor
+    int point_capacity;
+    int* bin_color; // visao por densidade: cor da maioria dos pontos de cada pixel
+    int* bin_votes;
+    XPoint* bin_points; // pixels ocupados agrupados por cor
+    int bin_capacity;
+    
+    // Indice espacial do dataset mostrado e a vista atual (zoom e centro, em coordenadas
+    // dos dados); a vista inicial e o dataset inteiro com zoom 1
+    PointGrid grid;
+    const DataSet* indexed;
+    double zoom;
+    double center_x;
+    double center_y;
+    
+    // Projecao dados -> tela, recalculada so quando a janela muda de tamanho ou a vista muda
+    double scale;
+    double offset_x;
+    double offset_y;
+    XPoint* screen_points; // coordenadas de tela dos pontos visiveis
+    int* screen_index; // indice no dataset de cada ponto visivel
+    int screen_capacity;
+    int visible_count;
+    long long visible_total; // pontos nas celulas visiveis, antes da amostragem
+    bool projection_valid;
+    
+    // Interacao: arrasto com o botao esquerdo e ponto sob o cursor (-1 nenhum)
+    bool dragging;
+    int drag_x;
+    int drag_y;
+    int picked;
+    
+    int step; // etapa mostrada no lugar do ARI enquanto o algoritmo roda (ARI = NAN)
 } X11Context;
 
-typedef enum {
-    CLUSTER_COLOR_BLACK = 0,
-    CLUSTER_COLOR_RED,
-    CLUSTER_COLOR_GREEN,
-    CLUSTER_COLOR_BLUE,
-    CLUSTER_COLOR_YELLOW,
-    CLUSTER_COLOR_MAGENTA,
-    CLUSTER_COLOR_CYAN,
-    CLUSTER_COLOR_ORANGE,
-    CLUSTER_COLOR_BROWN,
-    CLUSTER_COLOR_PINK,
-    CLUSTER_COLOR_GRAY,
-    CLUSTER_COLOR_LIME,
-    CLUSTER_COLOR_NAVY
-} ClusterColor;
-
 X11Context* init_x11(const char* window_title, int width, int height);
 
+// Copia o quadro para a janela, redesenhando-o antes se estiver invalido, e escreve por
+// cima o rotulo e o cluster do ponto sob o cursor
 void draw_points_on_expose(X11Context* x_context, const DataSet* dataset, double ari);
 
+// Marca o quadro para ser redesenhado no proximo Expose porque os rotulos mudaram (os ids
+// voltam a ser checados contra a paleta)
+void invalidate_frame(X11Context* x_context);
+
+// Controles: roda do mouse aproxima/afasta no cursor, arrastar com o botao esquerdo move,
+// +/- aproximam/afastam no centro, setas movem, 0 ou r voltam a vista inicial, q sai
 void run_x11_event_loop(X11Context* x_context, const DataSet* dataset, double ari);
 
 void close_x11(X11Context* x_context);
 
+// Janela numa thread propria, com laco de eventos que nao bloqueia: a cada VIEWER_POLL_MS
+// (ou evento do X) pega os rotulos mais recentes publicados pelo algoritmo. Depois de
+// aberta, so a thread do visualizador usa o X. O dataset so e lido (coordenadas e
+// rotulos dos pontos); o cluster_id dele pode mudar a vontade enquanto isso.
+typedef struct X11Viewer X11Viewer;
+
+// NULL se nao conseguir abrir a janela. Os pontos aparecem sem cluster ate a primeira
+// publicacao.
+X11Viewer* start_x11_viewer(const char* window_title, int width, int height, const DataSet* dataset);
+
+// Chamado pela thread do algoritmo: copia os rotulos sem esperar o visualizador. ari e
+// NAN enquanto o algoritmo roda (a janela mostra a etapa).
+void publish_to_viewer(X11Viewer* viewer, const int* cluster_id, int step, double ari);
+
+// A janela ja foi fechada pelo usuario
+bool x11_viewer_closed(X11Viewer* viewer);
+
+// Espera o usuario fechar a janela e libera o visualizador
+void join_x11_viewer(X11Viewer* viewer);
+
+// Gera as primeiras cores da paleta; as demais sao geradas quando aparecem clusters novos
 void initialize_cluster_colors(X11Context* x_context);
 
 #endif // X11_PLOTTER_H